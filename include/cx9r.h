@@ -44,7 +44,11 @@ enum cx9r_err_enum {
 	CX9R_AES256_FAILURE, // aes256 operation failed 15
 	CX9R_KEY_VERIFICATION_FAILED, // failed to verify key 16
 	CX9R_STREAM_OPEN_ERR, // error opening stream 17
-	CX9R_PARSE_ERR // parsing error 18
+	CX9R_PARSE_ERR, // parsing error 18
+	// unsupported inner random stream algorithm 19
+	CX9R_UNKNOWN_INNER_RANDOM_STREAM,
+	// snapshot missing, outdated or not authentic 20
+	CX9R_SNAPSHOT_MISS
 };
 
 
@@ -61,5 +65,15 @@ typedef void * cx9r_ctx; // context
 
 cx9r_err cx9r_init();
 cx9r_err cx9r_kdbx_read(FILE *f, char *passphrase, int flags, cx9r_key_tree** kt);
+// like cx9r_kdbx_read(), but load the tree from the snapshot at
+// snapshot_path when it matches the file, and save a snapshot otherwise
+cx9r_err cx9r_kdbx_read_cached(FILE *f, char *passphrase, int flags,
+		char const *snapshot_path, cx9r_key_tree** kt);
+// like cx9r_kdbx_read_cached(), but keep only the fields named in the NULL
+// terminated list fields (the Title is always kept), or all fields if it
+// is NULL; a snapshot is loaded but not saved for such a partial tree
+cx9r_err cx9r_kdbx_read_fields(FILE *f, char *passphrase, int flags,
+		char const *snapshot_path, char const *const *fields,
+		cx9r_key_tree** kt);
 
 #endif
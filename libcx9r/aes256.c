@@ -85,3 +85,40 @@ cx9r_err cx9r_aes256_cbc_close(cx9r_aes256_cbc_ctx *ctx) {
 	gcry_cipher_close(*ctx);
 	return CX9R_OK;
 }
+
+cx9r_err cx9r_aes256_ctr_init(cx9r_aes256_ctr_ctx *ctx, uint8_t *key,
+		uint8_t *iv) {
+	if (gcry_cipher_open(ctx, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_CTR, 0)
+			!= GPG_ERR_NO_ERROR)
+		goto bail;
+
+	if (gcry_cipher_setkey(*ctx, key, CX9R_AES256_KEY_LENGTH)
+			!= GPG_ERR_NO_ERROR)
+		goto cleanup;
+
+	if (gcry_cipher_setctr(*ctx, iv, CX9R_AES256_BLOCK_LENGTH)
+			!= GPG_ERR_NO_ERROR)
+		goto cleanup;
+
+	return CX9R_OK;
+
+	cleanup: gcry_cipher_close(*ctx);
+
+	bail: return CX9R_AES256_FAILURE;
+}
+
+// counter mode is symmetric, the same call encrypts and decrypts
+cx9r_err cx9r_aes256_ctr_crypt(cx9r_aes256_ctr_ctx *ctx, uint8_t *buffer,
+		size_t length) {
+	if (gcry_cipher_encrypt(*ctx, buffer, length, NULL, 0)
+			== GPG_ERR_NO_ERROR) {
+		return CX9R_OK;
+	} else {
+		return CX9R_AES256_FAILURE;
+	}
+}
+
+cx9r_err cx9r_aes256_ctr_close(cx9r_aes256_ctr_ctx *ctx) {
+	gcry_cipher_close(*ctx);
+	return CX9R_OK;
+}
@@ -32,6 +32,7 @@
 #   include <gcrypt.h>
     typedef gcry_cipher_hd_t cx9r_aes256_ecb_ctx;
     typedef gcry_cipher_hd_t cx9r_aes256_cbc_ctx;
+    typedef gcry_cipher_hd_t cx9r_aes256_ctr_ctx;
 #else
 #error No libgcrypt support for aes256
 #endif
@@ -46,6 +47,10 @@ cx9r_err cx9r_aes256_cbc_init(cx9r_aes256_ecb_ctx *ctx, uint8_t *key, uint8_t *i
 cx9r_err cx9r_aes256_cbc_decrypt(cx9r_aes256_ecb_ctx *ctx, uint8_t *buffer, size_t length);
 cx9r_err cx9r_aes256_cbc_close(cx9r_aes256_ecb_ctx *ctx);
 
+cx9r_err cx9r_aes256_ctr_init(cx9r_aes256_ctr_ctx *ctx, uint8_t *key, uint8_t *iv);
+cx9r_err cx9r_aes256_ctr_crypt(cx9r_aes256_ctr_ctx *ctx, uint8_t *buffer, size_t length);
+cx9r_err cx9r_aes256_ctr_close(cx9r_aes256_ctr_ctx *ctx);
+
 
 #endif
 
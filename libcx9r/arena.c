@@ -0,0 +1,126 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// alignment of all allocations
+#define ALIGNMENT 16
+#define ALIGN(n) (((n) + (ALIGNMENT - 1)) & ~((size_t)(ALIGNMENT - 1)))
+
+struct cx9r_arena_chunk {
+	cx9r_arena_chunk *next;
+	size_t size;	// usable bytes following the header
+	size_t used;	// bytes handed out
+};
+
+#define HEADER_SIZE ALIGN(sizeof(cx9r_arena_chunk))
+#define CHUNK_DATA(c) ((char*)(c) + HEADER_SIZE)
+
+// memset through a volatile pointer so that wiping memory that is about
+// to be freed is not optimized away
+static void *(*const volatile wipe)(void *, int, size_t) = memset;
+
+static cx9r_arena_chunk *chunk_alloc(size_t size) {
+	cx9r_arena_chunk *c;
+
+	if ((c = malloc(HEADER_SIZE + size)) == NULL) {
+		return NULL;
+	}
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	return c;
+}
+
+void cx9r_arena_init(cx9r_arena *arena) {
+	arena->chunks = NULL;
+}
+
+void *cx9r_arena_alloc(cx9r_arena *arena, size_t size) {
+	cx9r_arena_chunk *c = arena->chunks;
+	void *p;
+
+	size = ALIGN(size);
+
+	if (c == NULL || c->size - c->used < size) {
+		if (size > CX9R_ARENA_CHUNK_SIZE / 4) {
+			// large allocations get a chunk of their own, which is put
+			// behind the current one so that its free space is kept
+			if ((c = chunk_alloc(size)) == NULL) {
+				return NULL;
+			}
+			if (arena->chunks != NULL) {
+				c->next = arena->chunks->next;
+				arena->chunks->next = c;
+			}
+			else {
+				arena->chunks = c;
+			}
+		}
+		else {
+			if ((c = chunk_alloc(CX9R_ARENA_CHUNK_SIZE)) == NULL) {
+				return NULL;
+			}
+			c->next = arena->chunks;
+			arena->chunks = c;
+		}
+	}
+
+	p = CHUNK_DATA(c) + c->used;
+	c->used += size;
+	return p;
+}
+
+char *cx9r_arena_strndup(cx9r_arena *arena, char const *s, size_t length) {
+	char *p;
+
+	if ((p = cx9r_arena_alloc(arena, length + 1)) == NULL) {
+		return NULL;
+	}
+	memcpy(p, s, length);
+	p[length] = 0;
+	return p;
+}
+
+void cx9r_arena_get_usage(cx9r_arena const *arena, size_t *reserved,
+		size_t *used, size_t *n_chunks) {
+	cx9r_arena_chunk const *c;
+
+	*reserved = *used = *n_chunks = 0;
+	for (c = arena->chunks; c != NULL; c = c->next) {
+		*reserved += HEADER_SIZE + c->size;
+		*used += c->used;
+		(*n_chunks)++;
+	}
+}
+
+void cx9r_arena_free(cx9r_arena *arena) {
+	cx9r_arena_chunk *c = arena->chunks;
+	cx9r_arena_chunk *next;
+
+	while (c != NULL) {
+		next = c->next;
+		wipe(CHUNK_DATA(c), 0, c->used);
+		free(c);
+		c = next;
+	}
+	arena->chunks = NULL;
+}
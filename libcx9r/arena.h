@@ -0,0 +1,75 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_ARENA_H
+#define CX9R_ARENA_H
+
+#include <stdlib.h>
+
+// default size of an arena chunk in bytes
+#define CX9R_ARENA_CHUNK_SIZE 65536
+
+typedef struct cx9r_arena_chunk cx9r_arena_chunk;
+
+/// Bump allocator: memory is carved from large chunks and only
+/// released, after being wiped, when the whole arena is freed.
+typedef struct {
+	cx9r_arena_chunk *chunks;
+} cx9r_arena;
+
+/**
+ * Initialize an empty arena.
+ * @param arena arena
+ */
+void cx9r_arena_init(cx9r_arena *arena);
+
+/**
+ * Allocate memory from an arena, suitably aligned for any type.
+ * @param arena arena
+ * @param size number of bytes
+ * @return pointer to the memory, or NULL if allocation failed
+ */
+void *cx9r_arena_alloc(cx9r_arena *arena, size_t size);
+
+/**
+ * Copy a string into an arena and zero terminate it.
+ * @param arena arena
+ * @param s string to copy
+ * @param length number of characters to copy
+ * @return pointer to the copy, or NULL if allocation failed
+ */
+char *cx9r_arena_strndup(cx9r_arena *arena, char const *s, size_t length);
+
+/**
+ * Get the memory use of an arena.
+ * @param arena arena
+ * @param reserved set to the bytes obtained from malloc, headers included
+ * @param used set to the bytes handed out, alignment padding included
+ * @param n_chunks set to the number of chunks
+ */
+void cx9r_arena_get_usage(cx9r_arena const *arena, size_t *reserved,
+		size_t *used, size_t *n_chunks);
+
+/**
+ * Wipe and release all memory of an arena.
+ * @param arena arena
+ */
+void cx9r_arena_free(cx9r_arena *arena);
+
+#endif
@@ -17,8 +17,15 @@
  * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "base64.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BASE64_SIMD
+#endif
 
 //static char encoding_table[] = {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
 //                                'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
@@ -48,10 +55,11 @@ static uint8_t const dec[80] = { 0x3E, 0xFF, 0xFF, 0xFF, 0x3F, 0x34, 0x35, 0x36,
 #define BINARY_BLOCK_LENGTH 3
 #define INVALID_ASCII 0xFF
 
-#define PREPARE_INPUT(x, y) ((x = y - FIRST_VALID_ASCII) <= LAST_VALID_ASCII)
+#define PREPARE_INPUT(x, y) \
+	((x = y - FIRST_VALID_ASCII) <= LAST_VALID_ASCII - FIRST_VALID_ASCII)
 #define DECODE(x) ((x = dec[x]) != INVALID_ASCII)
 
-size_t base64_decode(void *out, char const *in, size_t length) {
+size_t base64_decode_scalar(void *out, char const *in, size_t length) {
 	uint8_t *o = (uint8_t*)out;
 	uint8_t *o_orig = o;
 	uint8_t buf[BASE64_BLOCK_LENGTH];
@@ -109,3 +117,161 @@ size_t base64_decode(void *out, char const *in, size_t length) {
 
 	return o - o_orig;
 }
+
+#ifdef BASE64_SIMD
+
+// Vectorized decoding after W. Mula and D. Lemire, "Faster Base64 Encoding
+// and Decoding using AVX2 Instructions": characters are validated and
+// translated to 6-bit values with nibble-indexed shuffle lookups, then
+// packed with multiply-adds. Blocks containing anything but the 64 alphabet
+// characters (including the '=' terminator) are left to the scalar decoder.
+
+#define SIMD_LUT_LO 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define SIMD_LUT_HI 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define SIMD_LUT_ROLL 0, 16, 19, 4, -65, -65, -71, -71, \
+		0, 0, 0, 0, 0, 0, 0, 0
+#define SIMD_PACK 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+#define SSE_BLOCK_LENGTH 16
+#define AVX2_BLOCK_LENGTH 32
+
+// decode blocks of 16 characters into 12 bytes, returns number of
+// characters consumed
+__attribute__((target("ssse3")))
+static size_t decode_ssse3(uint8_t **o, char const *in, size_t length) {
+	__m128i const lut_lo = _mm_setr_epi8(SIMD_LUT_LO);
+	__m128i const lut_hi = _mm_setr_epi8(SIMD_LUT_HI);
+	__m128i const lut_roll = _mm_setr_epi8(SIMD_LUT_ROLL);
+	__m128i const pack = _mm_setr_epi8(SIMD_PACK);
+	__m128i const mask_2f = _mm_set1_epi8(0x2f);
+	__m128i str, hi, lo, roll;
+	uint32_t tail;
+	size_t consumed = 0;
+
+	while (length - consumed >= SSE_BLOCK_LENGTH) {
+		str = _mm_loadu_si128((__m128i const*)(in + consumed));
+
+		// validate
+		hi = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+		lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(str, mask_2f));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo,
+				_mm_shuffle_epi8(lut_hi, hi)), _mm_setzero_si128())) != 0xFFFF) {
+			break;
+		}
+
+		// translate to 6-bit values, '/' is the only character
+		// that needs a different offset than the rest of its nibble
+		roll = _mm_shuffle_epi8(lut_roll,
+				_mm_add_epi8(_mm_cmpeq_epi8(str, mask_2f), hi));
+		str = _mm_add_epi8(str, roll);
+
+		// pack 4x6 bits into 3 bytes per 32-bit lane
+		str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+		str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+		str = _mm_shuffle_epi8(str, pack);
+
+		// store exactly 12 bytes so that in-place decoding stays safe
+		_mm_storel_epi64((__m128i*)*o, str);
+		// the output advances by 12, so the last 4 bytes may be unaligned
+		tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(str, 8));
+		memcpy(*o + 8, &tail, 4);
+		*o += 12;
+		consumed += SSE_BLOCK_LENGTH;
+	}
+
+	return consumed;
+}
+
+// decode blocks of 32 characters into 24 bytes, returns number of
+// characters consumed
+__attribute__((target("avx2")))
+static size_t decode_avx2(uint8_t **o, char const *in, size_t length) {
+	__m256i const lut_lo = _mm256_setr_epi8(SIMD_LUT_LO, SIMD_LUT_LO);
+	__m256i const lut_hi = _mm256_setr_epi8(SIMD_LUT_HI, SIMD_LUT_HI);
+	__m256i const lut_roll = _mm256_setr_epi8(SIMD_LUT_ROLL, SIMD_LUT_ROLL);
+	__m256i const pack = _mm256_setr_epi8(SIMD_PACK, SIMD_PACK);
+	__m256i const compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	__m256i const mask_2f = _mm256_set1_epi8(0x2f);
+	__m256i str, hi, lo, roll;
+	size_t consumed = 0;
+
+	while (length - consumed >= AVX2_BLOCK_LENGTH) {
+		str = _mm256_loadu_si256((__m256i const*)(in + consumed));
+
+		hi = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2f);
+		lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(str, mask_2f));
+		if (!_mm256_testz_si256(lo, _mm256_shuffle_epi8(lut_hi, hi))) {
+			break;
+		}
+
+		roll = _mm256_shuffle_epi8(lut_roll,
+				_mm256_add_epi8(_mm256_cmpeq_epi8(str, mask_2f), hi));
+		str = _mm256_add_epi8(str, roll);
+
+		str = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+		str = _mm256_madd_epi16(str, _mm256_set1_epi32(0x00011000));
+		str = _mm256_shuffle_epi8(str, pack);
+		// move the 12 bytes of the upper lane next to those of the lower
+		str = _mm256_permutevar8x32_epi32(str, compact);
+
+		_mm_storeu_si128((__m128i*)*o, _mm256_castsi256_si128(str));
+		_mm_storel_epi64((__m128i*)(*o + 16), _mm256_extracti128_si256(str, 1));
+		*o += 24;
+		consumed += AVX2_BLOCK_LENGTH;
+	}
+
+	// finish with a 16 character block if possible
+	return consumed + decode_ssse3(o, in + consumed, length - consumed);
+}
+
+typedef size_t (*decode_fn)(uint8_t **o, char const *in, size_t length);
+
+static size_t decode_none(uint8_t **o, char const *in, size_t length) {
+	(void)o;
+	(void)in;
+	(void)length;
+	return 0;
+}
+
+// select the widest block decoder supported by the cpu
+static decode_fn select_decoder(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return decode_avx2;
+	if (__builtin_cpu_supports("ssse3")) return decode_ssse3;
+	return decode_none;
+}
+
+size_t base64_decode(void *out, char const *in, size_t length) {
+	static decode_fn selected = NULL;
+	decode_fn decode_blocks = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+	uint8_t *o = (uint8_t*)out;
+	size_t consumed;
+	size_t n;
+
+	// atomic, as databases may be loaded on several threads; they all
+	// select the same decoder
+	if (decode_blocks == NULL) {
+		decode_blocks = select_decoder();
+		__atomic_store_n(&selected, decode_blocks, __ATOMIC_RELAXED);
+	}
+
+	// the last block may hold terminators and is always left to the
+	// scalar decoder
+	length &= ~((size_t)3);
+	consumed = length > BASE64_BLOCK_LENGTH ?
+			decode_blocks(&o, in, length - BASE64_BLOCK_LENGTH) : 0;
+
+	n = base64_decode_scalar(o, in + consumed, length - consumed);
+	if (n == (size_t)FORMAT_ERROR) return n;
+	return (o - (uint8_t*)out) + n;
+}
+
+#else
+
+size_t base64_decode(void *out, char const *in, size_t length) {
+	return base64_decode_scalar(out, in, length);
+}
+
+#endif
@@ -22,6 +22,10 @@
 
 #include <stdlib.h>
 
+// decode base64, using SIMD instructions where the cpu supports them;
+// returns the number of decoded bytes or (size_t)-1 on malformed input
 size_t base64_decode(void *out, char const *in, size_t length);
+// portable reference decoder, also used for the tail of base64_decode()
+size_t base64_decode_scalar(void *out, char const *in, size_t length);
 
 #endif
@@ -18,17 +18,21 @@
  */
 
 #include "base64.h"
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 
-static int check_test_vector(char *out, char const *in, char const *correct_out) {
+typedef size_t (*decoder)(void *out, char const *in, size_t length);
+
+static int check_test_vector(decoder decode, char *out, char const *in,
+		char const *correct_out) {
 
 	size_t n;
 
 	printf("Test vector: %s\n", in);
 	printf("Expected response: \"%s\"\n", correct_out);
-	n = base64_decode(out, in, strlen(in));
-	if (n < 0) {
+	n = decode(out, in, strlen(in));
+	if (n == (size_t)-1) {
 		printf("Decoding error\n");
 		return 1;
 	}
@@ -42,6 +46,96 @@ static int check_test_vector(char *out, char const *in, char const *correct_out)
 
 }
 
+static char const encoding_table[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// simple encoder for generating long test inputs
+static size_t encode(char *out, uint8_t const *in, size_t length) {
+	size_t i;
+	char *o = out;
+	uint32_t v;
+
+	for (i = 0; i + 2 < length; i += 3) {
+		v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+		*o++ = encoding_table[(v >> 18) & 63];
+		*o++ = encoding_table[(v >> 12) & 63];
+		*o++ = encoding_table[(v >> 6) & 63];
+		*o++ = encoding_table[v & 63];
+	}
+	if (length - i == 1) {
+		v = in[i] << 16;
+		*o++ = encoding_table[(v >> 18) & 63];
+		*o++ = encoding_table[(v >> 12) & 63];
+		*o++ = '=';
+		*o++ = '=';
+	}
+	else if (length - i == 2) {
+		v = (in[i] << 16) | (in[i + 1] << 8);
+		*o++ = encoding_table[(v >> 18) & 63];
+		*o++ = encoding_table[(v >> 12) & 63];
+		*o++ = encoding_table[(v >> 6) & 63];
+		*o++ = '=';
+	}
+	return o - out;
+}
+
+#define LONG_LENGTH 1000
+#define LONG_ENCODED_LENGTH ((LONG_LENGTH + 2) / 3 * 4)
+
+// compare the dispatching decoder against the scalar reference for
+// every length up to LONG_LENGTH, for valid and corrupted input
+static int check_long_inputs(void) {
+	static uint8_t plain[LONG_LENGTH];
+	static char encoded[LONG_ENCODED_LENGTH + 1];
+	static uint8_t out_scalar[LONG_LENGTH];
+	static uint8_t out_simd[LONG_ENCODED_LENGTH];
+	static char const bad[] = "=-*. \n\x80\xff";
+	size_t i, length, n_scalar, n_simd;
+	uint32_t seed = 1;
+
+	printf("Long inputs...");
+	for (i = 0; i < LONG_LENGTH; i++) {
+		seed = seed * 1103515245 + 12345;
+		plain[i] = (uint8_t)(seed >> 16);
+	}
+
+	for (length = 0; length <= LONG_LENGTH; length++) {
+		i = encode(encoded, plain, length);
+
+		n_scalar = base64_decode_scalar(out_scalar, encoded, i);
+		n_simd = base64_decode(out_simd, encoded, i);
+		if (n_scalar != length || n_simd != length
+				|| memcmp(out_scalar, plain, length) != 0
+				|| memcmp(out_simd, plain, length) != 0) {
+			printf("mismatch at length %lu\n", (unsigned long)length);
+			return 1;
+		}
+
+		// decoding in place must give the same result
+		memcpy(out_simd, encoded, i);
+		n_simd = base64_decode(out_simd, (char*)out_simd, i);
+		if (n_simd != length || memcmp(out_simd, plain, length) != 0) {
+			printf("in-place mismatch at length %lu\n", (unsigned long)length);
+			return 1;
+		}
+
+		// a bad character anywhere before the padding must be rejected
+		if (i > 4) {
+			seed = seed * 1103515245 + 12345;
+			encoded[(seed >> 16) % (i - 4)] = bad[(seed >> 8) % (sizeof(bad) - 1)];
+			n_scalar = base64_decode_scalar(out_scalar, encoded, i);
+			n_simd = base64_decode(out_simd, encoded, i);
+			if (n_scalar != (size_t)-1 || n_simd != (size_t)-1) {
+				printf("corruption not detected at length %lu\n",
+						(unsigned long)length);
+				return 1;
+			}
+		}
+	}
+	printf("ok\n");
+	return 0;
+}
+
 #define N_TEST_VECTORS 15
 
 static char const *challenges[N_TEST_VECTORS] = {
@@ -88,10 +182,17 @@ int main() {
 
 	for (i = 0; i < N_TEST_VECTORS; i++) {
 
-		if (check_test_vector(buf, challenges[i], responses[i]) != 0)
+		if (check_test_vector(base64_decode_scalar, buf, challenges[i],
+				responses[i]) != 0)
+			return 1;
+		if (check_test_vector(base64_decode, buf, challenges[i],
+				responses[i]) != 0)
 			return 1;
 	}
 
+	if (check_long_inputs() != 0)
+		return 1;
+
 	return 0;
 }
 
@@ -0,0 +1,226 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// ChaCha20 as specified in RFC 7539 (96-bit nonce, 32-bit block counter),
+// used by KDBX as inner random stream 3. Key stream is generated four
+// blocks at a time; with SSE2 the four blocks are computed in parallel,
+// one block per 32-bit vector lane.
+#include <stdio.h>
+#include "chacha20.h"
+
+#if ((BYTEORDER != 1234) && (BYTEORDER != 4321))
+#error Endianness unknown. Define BYTEORDER to 1234 or 4321.
+#endif
+
+#if defined(__SSE2__) && (BYTEORDER == 1234)
+#include <emmintrin.h>
+#define CHACHA20_SSE2
+#endif
+
+#define ROTL(v,n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d) {				\
+	x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL(x[d], 16);	\
+	x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL(x[b], 12);	\
+	x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL(x[d], 8);	\
+	x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL(x[b], 7);	\
+}
+
+#define DOUBLEROUND {				\
+	QUARTERROUND( 0,  4,  8, 12);	\
+	QUARTERROUND( 1,  5,  9, 13);	\
+	QUARTERROUND( 2,  6, 10, 14);	\
+	QUARTERROUND( 3,  7, 11, 15);	\
+	QUARTERROUND( 0,  5, 10, 15);	\
+	QUARTERROUND( 1,  6, 11, 12);	\
+	QUARTERROUND( 2,  7,  8, 13);	\
+	QUARTERROUND( 3,  4,  9, 14);	\
+}
+
+#define MIN(x,y) ((x) < (y)) ? (x) : (y)
+
+#define U8TO32_LITTLE(in) ((uint32_t)(in)[0] | ((uint32_t)(in)[1] << 8) | \
+		((uint32_t)(in)[2] << 16) | ((uint32_t)(in)[3] << 24))
+
+#define U32TO8_LITTLE(out, v) {		\
+	(out)[0] = (uint8_t)(v);		\
+	(out)[1] = (uint8_t)((v) >> 8);	\
+	(out)[2] = (uint8_t)((v) >> 16);	\
+	(out)[3] = (uint8_t)((v) >> 24);	\
+}
+
+#ifdef CHACHA20_SSE2
+
+#define VROTL(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define VQUARTERROUND(a, b, c, d) {		\
+	v[a] = _mm_add_epi32(v[a], v[b]); v[d] = _mm_xor_si128(v[d], v[a]); v[d] = VROTL(v[d], 16);	\
+	v[c] = _mm_add_epi32(v[c], v[d]); v[b] = _mm_xor_si128(v[b], v[c]); v[b] = VROTL(v[b], 12);	\
+	v[a] = _mm_add_epi32(v[a], v[b]); v[d] = _mm_xor_si128(v[d], v[a]); v[d] = VROTL(v[d], 8);	\
+	v[c] = _mm_add_epi32(v[c], v[d]); v[b] = _mm_xor_si128(v[b], v[c]); v[b] = VROTL(v[b], 7);	\
+}
+
+// generate four consecutive blocks of keystream, one block per vector lane
+static void chacha20_blocks(uint32_t const *state, uint8_t *out) {
+	__m128i v[CX9R_CHACHA20_STATE_LENGTH_32];
+	__m128i in[CX9R_CHACHA20_STATE_LENGTH_32];
+	__m128i t0, t1, t2, t3;
+	int i;
+
+	for (i = 0; i < CX9R_CHACHA20_STATE_LENGTH_32; i++) {
+		v[i] = in[i] = _mm_set1_epi32((int)state[i]);
+	}
+	v[12] = in[12] = _mm_add_epi32(in[12], _mm_set_epi32(3, 2, 1, 0));
+
+	for (i = 0; i < 10; i++) {
+		VQUARTERROUND( 0,  4,  8, 12);
+		VQUARTERROUND( 1,  5,  9, 13);
+		VQUARTERROUND( 2,  6, 10, 14);
+		VQUARTERROUND( 3,  7, 11, 15);
+		VQUARTERROUND( 0,  5, 10, 15);
+		VQUARTERROUND( 1,  6, 11, 12);
+		VQUARTERROUND( 2,  7,  8, 13);
+		VQUARTERROUND( 3,  4,  9, 14);
+	}
+
+	// add the input and transpose each group of four state words
+	// so that every lane ends up in its own block
+	for (i = 0; i < CX9R_CHACHA20_STATE_LENGTH_32; i += 4) {
+		v[i] = _mm_add_epi32(v[i], in[i]);
+		v[i + 1] = _mm_add_epi32(v[i + 1], in[i + 1]);
+		v[i + 2] = _mm_add_epi32(v[i + 2], in[i + 2]);
+		v[i + 3] = _mm_add_epi32(v[i + 3], in[i + 3]);
+
+		t0 = _mm_unpacklo_epi32(v[i], v[i + 1]);
+		t1 = _mm_unpacklo_epi32(v[i + 2], v[i + 3]);
+		t2 = _mm_unpackhi_epi32(v[i], v[i + 1]);
+		t3 = _mm_unpackhi_epi32(v[i + 2], v[i + 3]);
+
+		_mm_storeu_si128((__m128i*)(out + 4 * i),
+				_mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(out + CX9R_CHACHA20_STATE_LENGTH_8 + 4 * i),
+				_mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(out + 2 * CX9R_CHACHA20_STATE_LENGTH_8 + 4 * i),
+				_mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128((__m128i*)(out + 3 * CX9R_CHACHA20_STATE_LENGTH_8 + 4 * i),
+				_mm_unpackhi_epi64(t2, t3));
+	}
+}
+
+#else
+
+// generate one block of ChaCha20 keystream for the given counter value
+static void chacha20_block(uint32_t const *state, uint32_t counter,
+		uint8_t *out) {
+	uint32_t x[CX9R_CHACHA20_STATE_LENGTH_32];
+	uint32_t in[CX9R_CHACHA20_STATE_LENGTH_32];
+	int i;
+
+	for (i = 0; i < CX9R_CHACHA20_STATE_LENGTH_32; i++) {
+		x[i] = in[i] = state[i];
+	}
+	x[12] = in[12] = counter;
+
+	for (i = 0; i < 10; i++) {
+		DOUBLEROUND;
+	}
+
+	for (i = 0; i < CX9R_CHACHA20_STATE_LENGTH_32; i++) {
+		x[i] += in[i];
+		U32TO8_LITTLE(out + 4 * i, x[i]);
+	}
+}
+
+// generate four consecutive blocks of keystream
+static void chacha20_blocks(uint32_t const *state, uint8_t *out) {
+	int i;
+
+	for (i = 0; i < CX9R_CHACHA20_PARALLEL_BLOCKS; i++) {
+		chacha20_block(state, state[12] + i,
+				out + i * CX9R_CHACHA20_STATE_LENGTH_8);
+	}
+}
+
+#endif
+
+// refill the keystream buffer of a context
+static void chacha20_generate_output(cx9r_chacha20_ctx *ctx) {
+	chacha20_blocks(ctx->state, ctx->output);
+	ctx->pos = 0;
+	ctx->state[12] += CX9R_CHACHA20_PARALLEL_BLOCKS;
+	/* stopping at 2^38 bytes per nonce is user's responsibility */
+}
+
+static const char sigma[16] = "expand 32-byte k";
+
+void cx9r_chacha20_init(cx9r_chacha20_ctx *ctx, const uint8_t *key,
+		const uint8_t *nonce) {
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		ctx->state[i] = U8TO32_LITTLE((const uint8_t*)sigma + 4 * i);
+	}
+	for (i = 0; i < 8; i++) {
+		ctx->state[4 + i] = U8TO32_LITTLE(key + 4 * i);
+	}
+	ctx->state[12] = 0;
+	ctx->state[13] = U8TO32_LITTLE(nonce + 0);
+	ctx->state[14] = U8TO32_LITTLE(nonce + 4);
+	ctx->state[15] = U8TO32_LITTLE(nonce + 8);
+	ctx->pos = CX9R_CHACHA20_OUTPUT_LENGTH;
+}
+
+void cx9r_chacha20_encrypt(cx9r_chacha20_ctx *ctx, const uint8_t *input,
+		uint8_t *output, uint32_t length) {
+	uint32_t i;
+	uint32_t n;
+	uint8_t *keystream;
+
+	while (length) {
+
+		if (ctx->pos == CX9R_CHACHA20_OUTPUT_LENGTH) {
+			chacha20_generate_output(ctx);
+		}
+
+		n = MIN(CX9R_CHACHA20_OUTPUT_LENGTH - ctx->pos, length);
+
+		keystream = ctx->output + ctx->pos;
+
+		for (i = 0; i < n; i++) {
+			output[i] = input[i] ^ keystream[i];
+		}
+
+		length -= n;
+		output += n;
+		input += n;
+		ctx->pos += n;
+	}
+}
+
+void cx9r_chacha20_decrypt(cx9r_chacha20_ctx *ctx, const uint8_t *input,
+		uint8_t *output, uint32_t length) {
+	cx9r_chacha20_encrypt(ctx, input, output, length);
+}
+
+void cx9r_chacha20_keystream(cx9r_chacha20_ctx *ctx, uint8_t *output,
+		uint32_t length) {
+	uint32_t i;
+	for (i = 0; i < length; ++i) output[i] = 0;
+	cx9r_chacha20_encrypt(ctx, output, output, length);
+}
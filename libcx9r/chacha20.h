@@ -0,0 +1,89 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_CHACHA20_H
+#define CX9R_CHACHA20_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#else
+#error No stdint.h available
+#endif
+
+#define CX9R_CHACHA20_STATE_LENGTH_8 64
+#define CX9R_CHACHA20_STATE_LENGTH_32 (CX9R_CHACHA20_STATE_LENGTH_8/4)
+#define CX9R_CHACHA20_KEY_LENGTH 32
+#define CX9R_CHACHA20_NONCE_LENGTH 12
+// number of blocks of key stream generated per call to the block function
+#define CX9R_CHACHA20_PARALLEL_BLOCKS 4
+#define CX9R_CHACHA20_OUTPUT_LENGTH \
+	(CX9R_CHACHA20_STATE_LENGTH_8 * CX9R_CHACHA20_PARALLEL_BLOCKS)
+
+/// ChaCha20 context
+typedef struct {
+	uint32_t state[CX9R_CHACHA20_STATE_LENGTH_32];
+	uint8_t output[CX9R_CHACHA20_OUTPUT_LENGTH];
+	uint16_t pos;
+} cx9r_chacha20_ctx;
+
+/**
+ * Initialize ChaCha20 cipher (RFC 7539) with 256 bit key.
+ * The block counter starts at zero.
+ * @param ctx context
+ * @param key 256-bit key
+ * @param nonce 96-bit nonce
+ */
+void cx9r_chacha20_init(cx9r_chacha20_ctx *ctx, const uint8_t *key,
+		const uint8_t *nonce);
+
+/**
+ * Encrypt data with ChaCha20.
+ * @param ctx context
+ * @param input input (unencrypted) data
+ * @param output output (encrypted) data
+ * @param length length of data to process in bytes
+ */
+void cx9r_chacha20_encrypt(cx9r_chacha20_ctx *ctx, const uint8_t *input,
+		uint8_t *output, uint32_t length);
+
+/**
+ * Decrypt data with ChaCha20.
+ * @param ctx context
+ * @param input input (encrypted) data
+ * @param output output (unencrypted) data
+ * @param length length of data to process in bytes
+ */
+void cx9r_chacha20_decrypt(cx9r_chacha20_ctx *ctx, const uint8_t *input,
+		uint8_t *output, uint32_t length);
+
+/**
+ * Generate ChaCha20 key stream.
+ * This is equivalent to encrypting a stream of zeros.
+ * @param ctx context
+ * @param output key stream
+ * @param length length of data to process in bytes
+ */
+void cx9r_chacha20_keystream(cx9r_chacha20_ctx *ctx, uint8_t *output,
+		uint32_t length);
+
+#endif
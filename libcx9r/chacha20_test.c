@@ -0,0 +1,121 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chacha20.h"
+#include <string.h>
+#include <stdio.h>
+
+// RFC 7539 appendix A.1, test vector #1: all-zero key and nonce, counter 0
+static uint8_t const zero_keystream[64] = {
+		0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+		0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+		0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a,
+		0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+		0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d,
+		0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+		0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c,
+		0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86 };
+
+// RFC 7539 section 2.4.2: key 00..1f, nonce below, counter 1
+static uint8_t const nonce_2_4_2[12] = {
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4a,
+		0x00, 0x00, 0x00, 0x00 };
+
+static char const plaintext_2_4_2[] = "Ladies and Gentlemen of the class "
+		"of '99: If I could offer you only one tip for the future, sunscreen "
+		"would be it.";
+
+static uint8_t const ciphertext_2_4_2[114] = {
+		0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80,
+		0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+		0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2,
+		0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+		0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab,
+		0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+		0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab,
+		0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+		0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61,
+		0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+		0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06,
+		0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+		0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6,
+		0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+		0x87, 0x4d };
+
+#define LONG_LENGTH 4099
+
+int main() {
+
+	cx9r_chacha20_ctx ctx;
+	uint8_t key[CX9R_CHACHA20_KEY_LENGTH];
+	uint8_t nonce[CX9R_CHACHA20_NONCE_LENGTH];
+	uint8_t out[LONG_LENGTH];
+	uint8_t piecewise[LONG_LENGTH];
+	uint32_t i;
+	uint32_t n;
+
+	printf("Checking ChaCha20 test vectors...\n");
+
+	printf("zero key, zero nonce...");
+	memset(key, 0, sizeof(key));
+	memset(nonce, 0, sizeof(nonce));
+	cx9r_chacha20_init(&ctx, key, nonce);
+	cx9r_chacha20_keystream(&ctx, out, 64);
+	if (memcmp(out, zero_keystream, 64) != 0) goto fail;
+	printf("ok\n");
+
+	printf("RFC 7539 2.4.2 encryption...");
+	for (i = 0; i < sizeof(key); i++) key[i] = (uint8_t)i;
+	cx9r_chacha20_init(&ctx, key, nonce_2_4_2);
+	// skip block 0, the test vector starts at counter 1
+	cx9r_chacha20_keystream(&ctx, out, 64);
+	cx9r_chacha20_encrypt(&ctx, (uint8_t const*)plaintext_2_4_2, out,
+			sizeof(ciphertext_2_4_2));
+	if (memcmp(out, ciphertext_2_4_2, sizeof(ciphertext_2_4_2)) != 0) goto fail;
+	printf("ok\n");
+
+	printf("decryption round trip...");
+	cx9r_chacha20_init(&ctx, key, nonce_2_4_2);
+	cx9r_chacha20_keystream(&ctx, piecewise, 64);
+	cx9r_chacha20_decrypt(&ctx, out, out, sizeof(ciphertext_2_4_2));
+	if (memcmp(out, plaintext_2_4_2, sizeof(ciphertext_2_4_2)) != 0) goto fail;
+	printf("ok\n");
+
+	// the key stream must not depend on how it is split across calls,
+	// which exercises the boundaries of the multi-block buffer
+	printf("piecewise key stream...");
+	cx9r_chacha20_init(&ctx, key, nonce_2_4_2);
+	cx9r_chacha20_keystream(&ctx, out, LONG_LENGTH);
+	cx9r_chacha20_init(&ctx, key, nonce_2_4_2);
+	for (i = 0, n = 1; i < LONG_LENGTH; i += n, n = n * 3 % 97 + 1) {
+		if (n > LONG_LENGTH - i) n = LONG_LENGTH - i;
+		cx9r_chacha20_keystream(&ctx, piecewise + i, n);
+	}
+	if (memcmp(out, piecewise, LONG_LENGTH) != 0) goto fail;
+	printf("ok\n");
+
+	printf("All ChaCha20 tests passed\n");
+
+	return 0;
+
+	fail:
+
+	printf("fail\n");
+	return 1;
+}
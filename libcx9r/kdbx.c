@@ -24,11 +24,16 @@
 #include "aes256.h"
 #include "base64.h"
 #include "salsa20.h"
+#include "chacha20.h"
 #include "key_tree.h"
+#include "snapshot.h"
+#include "mem_stats.h"
 #include "util.h"
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 //global
 int g_enable_verbose = 0;
@@ -77,6 +82,11 @@ char* HeaderFieldNames[] = { "ID_EOH","ID_COMMENT","ID_CIPHER","ID_COMPRESSION",
 #define COMPRESSION_NONE 0	// no compression
 #define COMPRESSION_GZIP 1	// gzip compression
 
+#define INNER_RANDOM_STREAM_NONE 0	// protected values are not obfuscated
+#define INNER_RANDOM_STREAM_ARC4 1	// ArcFour variant (not supported)
+#define INNER_RANDOM_STREAM_SALSA20 2	// Salsa20
+#define INNER_RANDOM_STREAM_CHACHA20 3	// ChaCha20, default in KDBX 4
+
 // free a block of allocated memory and reset the pointer
 #define DEALLOC(x) do {if (x != NULL) {free(x); x = NULL;}} while(0)
 
@@ -92,6 +102,7 @@ typedef struct {
 	uint8_t *stream_start_bytes;
 	uint32_t inner_random_stream_id;
 	uint8_t *key;
+	uint8_t header_hash[CX9R_SHA256_HASH_LENGTH];	// of all header fields
 } ckpr_ctx_impl;
 
 // cipher ID for aes-cbc with pkcs7 padding (standard cipher)
@@ -224,23 +235,30 @@ static cx9r_err kdbx_read_header(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 	uint8_t id = 1;		// header field id
 	uint16_t size;		// header field size
 	uint8_t *data;		// header field data
+	cx9r_sha256_ctx sha_ctx;	// hash of the header
 	cx9r_err err = CX9R_OK;	// return value
 
+	CHEQ(((err = cx9r_sha256_init(&sha_ctx)) == CX9R_OK), kdbx_read_header_bail);
+
 	while (id) {
 		// read id
 		CHECK((cx9r_sread(&id, 1, sizeof(id), stream) == sizeof(id)), err,
-				CX9R_FILE_READ_ERR, kdbx_read_header_bail);
+				CX9R_FILE_READ_ERR, kdbx_read_header_cleanup_sha);
 
 		// read size
 		CHECK((cx9r_sread(&size, 1, sizeof(size), stream) == sizeof(size)), err,
-				CX9R_FILE_READ_ERR, kdbx_read_header_bail);
+				CX9R_FILE_READ_ERR, kdbx_read_header_cleanup_sha);
 
 		CHECK(((data = (uint8_t*)malloc(size)) != NULL), err,
-				CX9R_MEM_ALLOC_ERR, kdbx_read_header_bail);
+				CX9R_MEM_ALLOC_ERR, kdbx_read_header_cleanup_sha);
 
 		CHECK((cx9r_sread(data, 1, size, stream) == size), err, CX9R_FILE_READ_ERR,
 				kdbx_read_header_cleanup_data);
 
+		cx9r_sha256_process(&sha_ctx, &id, sizeof(id));
+		cx9r_sha256_process(&sha_ctx, (uint8_t*)&size, sizeof(size));
+		cx9r_sha256_process(&sha_ctx, data, size);
+
 		DEBUG("id: %d, field: %s, size: %d\n", id, HeaderFieldNames[id], size);
         DEBUGHEX(data,size);
 		//dbg(data, size);
@@ -297,6 +315,11 @@ static cx9r_err kdbx_read_header(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 		case ID_INNER_RANDOM_STREAM_ID:
 			CHECK((handle_uint32_field(&ctx->inner_random_stream_id, size, data)),
 					err, CX9R_WRONG_INNER_RANDOM_STREAM_ID_LENGTH, kdbx_read_header_cleanup_data);
+			// data has been consumed, bail without freeing it again
+			CHECK((ctx->inner_random_stream_id == INNER_RANDOM_STREAM_NONE
+					|| ctx->inner_random_stream_id == INNER_RANDOM_STREAM_SALSA20
+					|| ctx->inner_random_stream_id == INNER_RANDOM_STREAM_CHACHA20),
+					err, CX9R_UNKNOWN_INNER_RANDOM_STREAM, kdbx_read_header_cleanup_sha);
 			break;
 		default:
 			CHECK((0), err, CX9R_BAD_HEADER_FIELD_ID,
@@ -306,11 +329,15 @@ static cx9r_err kdbx_read_header(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 
 	}
 
+	err = cx9r_sha256_close(&sha_ctx, ctx->header_hash);
 	goto kdbx_read_header_bail;
 
 	kdbx_read_header_cleanup_data:
 	DEALLOC(data);
 
+	kdbx_read_header_cleanup_sha:
+	cx9r_sha256_close(&sha_ctx, ctx->header_hash);
+
 	kdbx_read_header_bail:
 
 	return err;
@@ -452,6 +479,7 @@ enum parse_tag_enum {
 	STRING,
 	KEY,
 	VALUE,
+	UUID,
 	OTHER,	// virtual tag - unrecognized tag
 	END		// virtual tag - used as end marker when detecting tag hierarchy
 };
@@ -465,6 +493,9 @@ enum parse_state_enum {
 	FIELD_KEY,
 	ENTRY_NAME,
 	FIELD_VALUE,
+	FIELD_SKIPPED,	// value of a field that is not kept
+	GROUP_UUID,
+	ENTRY_UUID,
 	ERROR
 };
 
@@ -492,20 +523,61 @@ struct user_data_struct {
 	cx9r_kt_field *current_field;
 	char *char_data_buf;			// for accumulating character data
 	int char_data_len;				// length of accumulated character data
-	cx9r_salsa20_ctx salsa20_ctx;
+	uint32_t inner_random_stream_id;	// cipher protecting obfuscated fields
+	union {
+		cx9r_salsa20_ctx salsa20;
+		cx9r_chacha20_ctx chacha20;
+	} inner_random_stream;
 	int obfuscated;					// whether field is obfuscated
+	char const *const *fields;		// names of the fields to keep, or NULL
+	int skip_field;					// whether the current field is not kept
 };
 
+// remove the inner random stream obfuscation of a protected value
+static void inner_random_stream_decrypt(user_data *ud, uint8_t *s, int len) {
+	switch (ud->inner_random_stream_id) {
+	case INNER_RANDOM_STREAM_SALSA20:
+		cx9r_salsa20_decrypt(&ud->inner_random_stream.salsa20, s, s, len);
+		break;
+	case INNER_RANDOM_STREAM_CHACHA20:
+		cx9r_chacha20_decrypt(&ud->inner_random_stream.chacha20, s, s, len);
+		break;
+	}
+}
+
+// check if a field is to be kept; standard field names match in any case
+static int field_wanted(user_data *ud, char const *s, int len) {
+	char const *const *f;
+	char const *name;
+	int id;
+
+	if (ud->fields == NULL) return 1;
+	for (f = ud->fields; *f != NULL; f++) {
+		if (strlen(*f) != (size_t)len || strncasecmp(*f, s, len) != 0) continue;
+		if (strncmp(*f, s, len) == 0) return 1;
+		for (id = 0; id < CX9R_N_STD_FIELDS; id++) {
+			name = cx9r_key_tree_get_field_name(ud->key_tree, id);
+			if (strncmp(name, s, len) == 0 && name[len] == 0) return 1;
+		}
+	}
+	return 0;
+}
+
 // not a pure pop - pops all elements above data
 static parse_data *parse_data_pop(parse_data *data) {
 	parse_data *prev;
+	parse_data *next;
 	if (data == NULL) return NULL;
-	parse_data_pop(data->next);
 	prev = data->prev;
 	if (prev != NULL) {
 		prev->next = NULL;
 	}
-	free(data);
+	// free data and everything pushed above it
+	while (data != NULL) {
+		next = data->next;
+		free(data);
+		data = next;
+	}
 	return prev;
 }
 
@@ -524,21 +596,26 @@ static parse_data *parse_data_push(parse_data *top) {
 	return pd;
 }
 
-#define N_TAGS 8
+#define N_TAGS 9
 static char const *string_tags[N_TAGS] = {"KeePassFile", "Root", "Group", "Entry",
-		"Name", "String", "Key", "Value"};
+		"Name", "String", "Key", "Value", "UUID"};
 static parse_tag const tags[N_TAGS] = {TOP, ROOT, GROUP, ENTRY, NAME,
-		STRING, KEY, VALUE};
+		STRING, KEY, VALUE, UUID};
 // conditions for recognizing certain contexts in the xml
 static parse_tag const root_condition[] = {GROUP, ROOT, TOP, END};
 static parse_tag const root_name_condition[] = {NAME, GROUP, ROOT, TOP, END};
 static parse_tag const group_condition[] = {GROUP, END};
 static parse_tag const subgroup_condition[] = {GROUP, GROUP, END};
 static parse_tag const subgroup_name_condition[] = {NAME, GROUP, GROUP, END};
+static parse_tag const group_uuid_condition[] = {UUID, GROUP, END};
 static parse_tag const entry_condition[] = {ENTRY, GROUP, END};
+static parse_tag const entry_uuid_condition[] = {UUID, ENTRY, GROUP, END};
 static parse_tag const entry_key_condition[] = {KEY, STRING, ENTRY, GROUP, END};
 static parse_tag const entry_value_condition[] = {VALUE, STRING, ENTRY, GROUP, END};
 
+// length of a base64 encoded uuid, including padding
+#define UUID_BASE64_LENGTH 24
+
 static char const *entry_name_tag = "Title";
 static char const *protected_tag = "Protected";
 static char const *true_tag = "True";
@@ -600,20 +677,29 @@ static void start_element_handler(void *userData,
 		// we are at the name of a subgroup
 		ud->state = GROUP_NAME;
 	}
+	else if (check_state_condition(group_uuid_condition, ud->stack_top)) {
+		ud->state = GROUP_UUID;
+	}
 	else if (check_state_condition(entry_condition, ud->stack_top)) {
 		// at entry - add an entry to the current group
 		ud->current_entry = cx9r_kt_group_add_entry(ud->current_group);
 		if (ud->current_entry == NULL) goto bail;
 	}
+	else if (check_state_condition(entry_uuid_condition, ud->stack_top)) {
+		// uuids of entries in the history are not reached, as their
+		// entries are below a History tag
+		ud->state = ENTRY_UUID;
+	}
 	else if (check_state_condition(entry_key_condition, ud->stack_top)) {
 		// at field key - wait until we know if this is the
 		// title field to take appropriate action
 		ud->state = FIELD_KEY;
+		ud->skip_field = 0;
 	}
 	else if (check_state_condition(entry_value_condition, ud->stack_top)) {
 		// at field value if this is not the title field
 		if (ud->state != ENTRY_NAME) {
-			ud->state = FIELD_VALUE;
+			ud->state = ud->skip_field ? FIELD_SKIPPED : FIELD_VALUE;
 		}
 	}
 
@@ -646,6 +732,7 @@ static void buffered_character_data_handler(void *userData,
 		int len) {
 
 	user_data *ud;
+	uint8_t uuid[UUID_BASE64_LENGTH];
 	ud = (user_data*)userData;
 	if (ud->state == ERROR) return;
 
@@ -655,7 +742,7 @@ static void buffered_character_data_handler(void *userData,
         DEBUG("after base64 len=%d   ",len);DEBUGHEX(s,len);
         if (len < 0) {len = 0; printf("Warning: ignoring invalid base64-decoded password\n"); }
 		if (len < 0) goto bail;
-        cx9r_salsa20_decrypt(&ud->salsa20_ctx, s, s, len);
+        inner_random_stream_decrypt(ud, s, len);
         s[len] = 0;
         DEBUG("plain=%s\n\n", s);
 	}
@@ -671,6 +758,9 @@ static void buffered_character_data_handler(void *userData,
 		if (strncmp(s, entry_name_tag, len) == 0) {
 			ud->state = ENTRY_NAME;
 		}
+		else if (!field_wanted(ud, s, len)) {
+			ud->skip_field = 1;
+		}
 		else {
 			ud->current_field = cx9r_kt_entry_add_field(ud->current_entry);
 			if (ud->current_field == NULL) goto bail;
@@ -682,6 +772,15 @@ static void buffered_character_data_handler(void *userData,
 	}
 	else if (ud->state == FIELD_VALUE) {
 		if (cx9r_kt_field_set_value(ud->current_field, s, len) == NULL) goto bail;
+		cx9r_kt_field_set_protected(ud->current_field, ud->obfuscated);
+	}
+	else if (ud->state == GROUP_UUID || ud->state == ENTRY_UUID) {
+		// a malformed uuid is ignored, leaving the node without one
+		if (len != UUID_BASE64_LENGTH || base64_decode(uuid, s, len)
+				!= CX9R_UUID_LENGTH) return;
+		if (ud->state == GROUP_UUID)
+			cx9r_kt_group_set_uuid(ud->current_group, uuid);
+		else cx9r_kt_entry_set_uuid(ud->current_entry, uuid);
 	}
 
 	return;
@@ -704,7 +803,7 @@ static void end_element_handler(void *userData,
 	// last opening tag, we handle it now
 	if (ud->char_data_buf != NULL) {
 		buffered_character_data_handler(ud, ud->char_data_buf, ud->char_data_len);
-		free(ud->char_data_buf);
+		cx9r_mem_free(CX9R_MEM_XML, ud->char_data_buf);
 		ud->char_data_buf = NULL;
 	}
     // signal that we should not process character data
@@ -751,25 +850,29 @@ static void character_data_handler(void *userData,
 	ud = (user_data*)userData;
 	if (ud->state == ERROR)	return;
 	if (ud->char_data_len < 0) return;
+	// a protected value is still decrypted to keep the inner random
+	// stream in step, others are dropped right away
+	if (ud->state == FIELD_SKIPPED && !ud->obfuscated) return;
 
+	// one spare byte, for terminating decrypted values in place
 	if (ud->char_data_buf == NULL) {
-		ud->char_data_buf = malloc(len);
+		ud->char_data_buf = cx9r_mem_alloc(CX9R_MEM_XML, len + 1);
 		if (ud->char_data_buf == NULL) goto bail;
 		memcpy(ud->char_data_buf, s, len);
 		ud->char_data_len = len;
 	}
 	else {
 		t_len = ud->char_data_len + len;
-		t = malloc(t_len);
+		t = cx9r_mem_alloc(CX9R_MEM_XML, t_len + 1);
 		if (t == NULL) {
-			free(ud->char_data_buf);
+			cx9r_mem_free(CX9R_MEM_XML, ud->char_data_buf);
 			ud->char_data_buf = NULL;
 			ud->char_data_len = 0;
 			goto bail;
 		}
 		memcpy(t, ud->char_data_buf, ud->char_data_len);
 		memcpy(t + ud->char_data_len, s, len);
-		free(ud->char_data_buf);
+		cx9r_mem_free(CX9R_MEM_XML, ud->char_data_buf);
 		ud->char_data_buf = t;
 		ud->char_data_len = t_len;
 	}
@@ -782,7 +885,25 @@ bail:
 	XML_StopParser(ud->parser, XML_FALSE);
 }
 
-static cx9r_key_tree* parse_xml(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
+// expat allocates through these, so that its memory is accounted for
+static void *xml_malloc(size_t size) {
+	return cx9r_mem_alloc(CX9R_MEM_XML, size);
+}
+
+static void *xml_realloc(void *p, size_t size) {
+	return cx9r_mem_realloc(CX9R_MEM_XML, p, size);
+}
+
+static void xml_free(void *p) {
+	cx9r_mem_free(CX9R_MEM_XML, p);
+}
+
+static XML_Memory_Handling_Suite const xml_memory = {
+	xml_malloc, xml_realloc, xml_free
+};
+
+static cx9r_key_tree* parse_xml(cx9r_stream_t *stream, ckpr_ctx_impl *ctx,
+		char const *const *fields) {
 	cx9r_err err = CX9R_OK;
 	XML_Parser parser;
 	size_t n;
@@ -793,8 +914,9 @@ static cx9r_key_tree* parse_xml(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 	uint8_t const salsa20_iv[] = {0xE8, 0x30, 0x09, 0x4B,
 			0x97, 0x20, 0x5D, 0x2A};
 	uint8_t salsa20_key[CX9R_SHA256_HASH_LENGTH];
+	uint8_t chacha20_key[CX9R_SHA512_HASH_LENGTH];
 
-	CHECK(((parser = XML_ParserCreate(NULL)) != NULL), err,
+	CHECK(((parser = XML_ParserCreate_MM(NULL, &xml_memory, NULL)) != NULL), err,
 			CX9R_MEM_ALLOC_ERR, bail);
 
 	CHECK(((parse_stack = parse_data_push(NULL)) != NULL), err,
@@ -803,11 +925,6 @@ static cx9r_key_tree* parse_xml(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 	CHECK(((kt = cx9r_key_tree_create()) != NULL), err,
 			CX9R_MEM_ALLOC_ERR, dealloc_key_tree);
 
-	cx9r_sha256_hash_buffer(salsa20_key, ctx->protected_stream_key,
-			ctx->protected_stream_key_length);
-    
-    DEBUG("Salsa20 key:");DEBUGHEX(salsa20_key,CX9R_SHA256_HASH_LENGTH);
-    
 	ud.stack_top = parse_stack;
 	ud.parser = parser;
 	ud.state = UNKNOWN;
@@ -817,7 +934,24 @@ static cx9r_key_tree* parse_xml(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 	ud.current_field = NULL;
 	ud.char_data_buf = NULL;
 	ud.char_data_len = 0;
-	cx9r_salsa20_256_init(&ud.salsa20_ctx, salsa20_key, salsa20_iv);
+	ud.fields = fields;
+	ud.skip_field = 0;
+	ud.inner_random_stream_id = ctx->inner_random_stream_id;
+	if (ctx->inner_random_stream_id == INNER_RANDOM_STREAM_SALSA20) {
+		cx9r_sha256_hash_buffer(salsa20_key, ctx->protected_stream_key,
+				ctx->protected_stream_key_length);
+		DEBUG("Salsa20 key:");DEBUGHEX(salsa20_key,CX9R_SHA256_HASH_LENGTH);
+		cx9r_salsa20_256_init(&ud.inner_random_stream.salsa20, salsa20_key,
+				salsa20_iv);
+	}
+	else if (ctx->inner_random_stream_id == INNER_RANDOM_STREAM_CHACHA20) {
+		// key and nonce are taken from the SHA-512 of the protected stream key
+		cx9r_sha512_hash_buffer(chacha20_key, ctx->protected_stream_key,
+				ctx->protected_stream_key_length);
+		DEBUG("ChaCha20 key:");DEBUGHEX(chacha20_key,CX9R_SHA512_HASH_LENGTH);
+		cx9r_chacha20_init(&ud.inner_random_stream.chacha20, chacha20_key,
+				chacha20_key + CX9R_CHACHA20_KEY_LENGTH);
+	}
 	parse_stack->state = START;
 
 	XML_SetUserData(parser, &ud);
@@ -828,7 +962,7 @@ static cx9r_key_tree* parse_xml(cx9r_stream_t *stream, ckpr_ctx_impl *ctx) {
 
 int parse_err;
 	while (!cx9r_seof(stream)) {
-		n = cx9r_sread(buf, 1, 1028, stream);
+		n = cx9r_sread(buf, 1, sizeof(buf), stream);
 		CHECK(((parse_err=XML_Parse(parser, buf, n, 0)) == XML_STATUS_OK), err,
 				CX9R_PARSE_ERR, dealloc_key_tree);
 	}
@@ -838,6 +972,9 @@ int parse_err;
     if (ISDEBUG&&err==CX9R_PARSE_ERR)printf("Parse Error: %d", parse_err);
 	CHECK((ud.state != ERROR), err, CX9R_PARSE_ERR, dealloc_key_tree);
 
+	CHECK((cx9r_key_tree_index_uuids(kt)), err, CX9R_MEM_ALLOC_ERR,
+			dealloc_key_tree);
+
     goto dealloc_user_data;
     
 //	cx9r_dump_tree(kt);
@@ -850,7 +987,7 @@ dealloc_key_tree:
 dealloc_user_data:
 
 	if (ud.char_data_buf != NULL) {
-		free (ud.char_data_buf);
+		cx9r_mem_free(CX9R_MEM_XML, ud.char_data_buf);
 	}
 
 dealloc_stack:
@@ -874,9 +1011,33 @@ cx9r_err cx9r_init() {
 	return CX9R_OK;
 }
 
+// identify the state of a database file for its snapshot
+static int snapshot_identify(FILE *f, ckpr_ctx_impl *ctx, cx9r_snapshot_id *id) {
+	struct stat st;
+
+	if (fstat(fileno(f), &st) != 0) return 0;
+	memcpy(id->header_hash, ctx->header_hash, CX9R_SHA256_HASH_LENGTH);
+	id->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	id->size = (uint64_t)st.st_size;
+	return 1;
+}
+
 cx9r_err cx9r_kdbx_read(FILE *f, char *passphrase, int flags, cx9r_key_tree **kt) {
+	return cx9r_kdbx_read_cached(f, passphrase, flags, NULL, kt);
+}
+
+cx9r_err cx9r_kdbx_read_cached(FILE *f, char *passphrase, int flags,
+		char const *snapshot_path, cx9r_key_tree **kt) {
+	return cx9r_kdbx_read_fields(f, passphrase, flags, snapshot_path, NULL, kt);
+}
+
+cx9r_err cx9r_kdbx_read_fields(FILE *f, char *passphrase, int flags,
+		char const *snapshot_path, char const *const *fields,
+		cx9r_key_tree **kt) {
 	cx9r_err err = CX9R_OK;
 	ckpr_ctx_impl *ctx;
+	cx9r_snapshot_id id;
+	int use_snapshot;
 	cx9r_stream_t *stream;
 	cx9r_stream_t *decrypted_stream;
 	cx9r_stream_t *hashed_stream;
@@ -899,6 +1060,18 @@ DEBUG("1 ");
 DEBUG("2 ");
 	CHEQ(((err = generate_key(ctx, passphrase)) == CX9R_OK), cleanup_ctx);
 	memset(passphrase, 0, strlen(passphrase));
+	cx9r_mem_sample(CX9R_MEM_PHASE_KEY);
+
+	// a snapshot made with another key fails authentication, so loading
+	// one also verifies the passphrase
+	use_snapshot = snapshot_path != NULL && !(flags & FLAG_DUMP_XML)
+			&& snapshot_identify(f, ctx, &id);
+	if (use_snapshot
+			&& cx9r_snapshot_load(snapshot_path, ctx->key, &id, kt) == CX9R_OK) {
+		DEBUG("Loaded snapshot %s\n", snapshot_path);
+		cx9r_mem_sample(CX9R_MEM_PHASE_PARSE);
+		goto cleanup_ctx;
+	}
 DEBUG("3 ");
 	CHECK(((decrypted_stream = cx9r_aes256_cbc_sopen(stream, ctx->key, ctx->iv)) != NULL),
 			err, CX9R_STREAM_OPEN_ERR, cleanup_ctx);
@@ -930,7 +1103,12 @@ DEBUG("6\n");
         //
         //	fclose(o);
     } else {
-        CHECK(((*kt = parse_xml(stream, ctx)) != NULL), err, CX9R_PARSE_ERR, cleanup_ctx);
+        CHECK(((*kt = parse_xml(stream, ctx, fields)) != NULL), err, CX9R_PARSE_ERR, cleanup_ctx);
+        cx9r_mem_sample(CX9R_MEM_PHASE_PARSE);
+        // a snapshot always holds all fields
+        if (use_snapshot && fields == NULL
+                && cx9r_snapshot_save(snapshot_path, *kt, ctx->key, &id) != CX9R_OK)
+            DEBUG("Could not save snapshot %s\n", snapshot_path);
     }
 cleanup_ctx:
 	ctx_free(ctx);
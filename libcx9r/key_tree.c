@@ -21,85 +21,254 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 
-/*
-struct cx9r_ktf {
-	char *name;
-	char *value;
-	cx9r_kt_field *next;
+// names of the predefined field ids
+static char const *const std_field_names[CX9R_N_STD_FIELDS] = {
+	"Title", "UserName", "Password", "URL", "Notes"
 };
 
-struct cx9r_kte {
-	char *name;
-	cx9r_kt_field *fields;
-	cx9r_kt_entry *next;
-};
+#define ATOMS_INITIAL_SLOTS 64
 
-struct cx9r_ktg {
-	char *name;
-	cx9r_kt_group *parent;
-	cx9r_kt_group *children;
-	cx9r_kt_group *next;
-	cx9r_kt_entry *entries;
-};
+// FNV-1a
+static uint32_t hash_name(char const *name, size_t length) {
+	uint32_t h = 2166136261u;
+	while (length--) {
+		h ^= (uint8_t)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// find the slot of a name, or the empty slot where it belongs
+static int *atoms_find(cx9r_kt_atoms const *atoms, char const *name,
+		size_t length) {
+	size_t mask = atoms->slots_capacity - 1;
+	size_t i = hash_name(name, length) & mask;
+	int *slot;
+	char const *n;
+
+	for (;; i = (i + 1) & mask) {
+		slot = &atoms->slots[i];
+		if (*slot < 0) return slot;
+		n = atoms->names[*slot];
+		if (strncmp(n, name, length) == 0 && n[length] == 0) return slot;
+	}
+}
+
+// double the hash table
+static int atoms_grow(cx9r_kt_atoms *atoms) {
+	int *old = atoms->slots;
+	size_t old_capacity = atoms->slots_capacity;
+	size_t i;
+	char const *n;
+
+	atoms->slots_capacity = old_capacity ? 2 * old_capacity : ATOMS_INITIAL_SLOTS;
+	if ((atoms->slots = malloc(atoms->slots_capacity * sizeof(int))) == NULL) {
+		atoms->slots = old;
+		atoms->slots_capacity = old_capacity;
+		return 0;
+	}
+	memset(atoms->slots, 0xff, atoms->slots_capacity * sizeof(int));
+	for (i = 0; i < atoms->n_names; i++) {
+		n = atoms->names[i];
+		*atoms_find(atoms, n, strlen(n)) = (int)i;
+	}
+	free(old);
+	return 1;
+}
+
+int cx9r_key_tree_intern(cx9r_key_tree *kt, char const *name, size_t length) {
+	cx9r_kt_atoms *atoms = &kt->atoms;
+	char const **names;
+	char *copy;
+	int *slot;
+
+	slot = atoms_find(atoms, name, length);
+	if (*slot >= 0) return *slot;
+
+	// keep the load factor at or below one half
+	if (2 * (atoms->n_names + 1) > atoms->slots_capacity) {
+		if (!atoms_grow(atoms)) return CX9R_FIELD_NONE;
+		slot = atoms_find(atoms, name, length);
+	}
+	if (atoms->n_names == atoms->names_capacity) {
+		names = realloc(atoms->names,
+				2 * atoms->names_capacity * sizeof(char const*));
+		if (names == NULL) return CX9R_FIELD_NONE;
+		atoms->names = names;
+		atoms->names_capacity *= 2;
+	}
+	if ((copy = cx9r_arena_strndup(&kt->arena, name, length)) == NULL) {
+		return CX9R_FIELD_NONE;
+	}
+	atoms->names[atoms->n_names] = copy;
+	*slot = (int)atoms->n_names;
+	return (int)atoms->n_names++;
+}
+
+int cx9r_key_tree_lookup_field_id(cx9r_key_tree const *kt, char const *name) {
+	return *atoms_find(&kt->atoms, name, strlen(name));
+}
+
+char const *cx9r_key_tree_get_field_name(cx9r_key_tree const *kt, int id) {
+	if (id < 0 || (size_t)id >= kt->atoms.n_names) return NULL;
+	return kt->atoms.names[id];
+}
 
-struct cx9r_kt {
-	cx9r_kt_group root;
-};
-*/
 cx9r_key_tree *cx9r_key_tree_create() {
 	cx9r_key_tree *kt;
+	int i;
 
 	if ((kt = malloc(sizeof(cx9r_key_tree))) == NULL) {
 		return NULL;
 	}
 
+	cx9r_arena_init(&kt->arena);
+	kt->atoms.n_names = CX9R_N_STD_FIELDS;
+	kt->atoms.names_capacity = 2 * CX9R_N_STD_FIELDS;
+	kt->atoms.slots = NULL;
+	kt->atoms.slots_capacity = 0;
+	if ((kt->atoms.names = malloc(kt->atoms.names_capacity
+			* sizeof(char const*))) == NULL) {
+		free(kt);
+		return NULL;
+	}
+	for (i = 0; i < CX9R_N_STD_FIELDS; i++) {
+		kt->atoms.names[i] = std_field_names[i];
+	}
+	if (!atoms_grow(&kt->atoms)) {
+		free(kt->atoms.names);
+		free(kt);
+		return NULL;
+	}
+
+	kt->uuid_slots = NULL;
+	kt->uuid_capacity = 0;
+	kt->root.tree = kt;
+	kt->root.depth = 0;
+	kt->root.path_length = 0;
 	kt->root.parent = NULL;
 	kt->root.children = NULL;
 	kt->root.next = NULL;
 	kt->root.entries = NULL;
 	kt->root.name = NULL;
+	memset(kt->root.uuid, 0, CX9R_UUID_LENGTH);
+	kt->root.children_tail = NULL;
+	kt->root.entries_tail = NULL;
+	kt->root.n_children = 0;
+	kt->root.n_entries = 0;
+	kt->root.child_index = NULL;
+	kt->root.entry_index = NULL;
+	kt->root.n_child_indexed = 0;
+	kt->root.n_entry_indexed = 0;
+	kt->root.child_index_capacity = 0;
+	kt->root.entry_index_capacity = 0;
 
 	return kt;
 }
 
-static void field_free(cx9r_kt_field *ktf) {
-	if (ktf != NULL) {
-		field_free(ktf->next);
-		free(ktf->name);
-		free(ktf->value);
-		free(ktf);
-	}
+// all nodes and strings live in the arena, which wipes them on release
+void cx9r_key_tree_free(cx9r_key_tree *kt) {
+	free(kt->atoms.names);
+	free(kt->atoms.slots);
+	free(kt->uuid_slots);
+	cx9r_arena_free(&kt->arena);
+	memset(kt, 0, sizeof(cx9r_key_tree));
+	free(kt);
 }
 
-static void entry_free(cx9r_kt_entry *kte) {
-	if (kte != NULL) {
-		entry_free(kte->next);
-		field_free(kte->fields);
-		free(kte->name);
-		free(kte);
-	}
+cx9r_kt_group *cx9r_key_tree_get_root(cx9r_key_tree *kt) {
+	return &kt->root;
+}
+
+#define UUID_INITIAL_SLOTS 16
+
+static uint8_t const no_uuid[CX9R_UUID_LENGTH];
+
+// uuids are random, so their leading bytes serve as hash
+static size_t hash_uuid(uint8_t const *uuid) {
+	uint64_t h;
+	memcpy(&h, uuid, sizeof(h));
+	return (size_t)(h ^ h >> 32);
 }
 
-static void group_free(cx9r_kt_group *ktg) {
-	if (ktg != NULL) {
-		group_free(ktg->children);
-		group_free(ktg->next);
-		entry_free(ktg->entries);
-		free(ktg->name);
-		free(ktg);
+static uint8_t const *slot_uuid(cx9r_kt_uuid_slot const *slot) {
+	return slot->entry != NULL ? slot->entry->uuid : slot->group->uuid;
+}
+
+// find the slot of a uuid, or the empty slot where it belongs
+static cx9r_kt_uuid_slot *uuid_find(cx9r_key_tree const *kt,
+		uint8_t const *uuid) {
+	size_t mask = kt->uuid_capacity - 1;
+	size_t i = hash_uuid(uuid) & mask;
+	cx9r_kt_uuid_slot *slot;
+
+	for (;; i = (i + 1) & mask) {
+		slot = &kt->uuid_slots[i];
+		if (slot->group == NULL) return slot;
+		if (memcmp(slot_uuid(slot), uuid, CX9R_UUID_LENGTH) == 0) return slot;
 	}
 }
 
-void cx9r_key_tree_free(cx9r_key_tree *kt) {
-	group_free(kt->root.children);
-	entry_free(kt->root.entries);
-	free(kt->root.name);
-	free(kt);
+// drop the uuid index after the tree changed
+static void uuid_index_invalidate(cx9r_key_tree *kt) {
+	free(kt->uuid_slots);
+	kt->uuid_slots = NULL;
 }
 
-cx9r_kt_group *cx9r_key_tree_get_root(cx9r_key_tree *kt) {
-	return &kt->root;
+int cx9r_key_tree_index_uuids(cx9r_key_tree *kt) {
+	cx9r_kt_iter it;
+	cx9r_kt_uuid_slot *slot;
+	uint8_t const *uuid;
+	size_t n = 0;
+
+	cx9r_kt_iter_init(&it, &kt->root, CX9R_KT_ITER_ENTRIES);
+	while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) {
+		n++;
+	}
+
+	// keep the load factor at or below one half
+	uuid_index_invalidate(kt);
+	for (kt->uuid_capacity = UUID_INITIAL_SLOTS; kt->uuid_capacity < 2 * n;
+			kt->uuid_capacity *= 2);
+	if ((kt->uuid_slots = calloc(kt->uuid_capacity,
+			sizeof(cx9r_kt_uuid_slot))) == NULL) {
+		return 0;
+	}
+
+	cx9r_kt_iter_init(&it, &kt->root, CX9R_KT_ITER_ENTRIES);
+	while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) {
+		uuid = it.event == CX9R_KT_ITER_ENTRY ? it.entry->uuid : it.group->uuid;
+		if (memcmp(uuid, no_uuid, CX9R_UUID_LENGTH) == 0) continue;
+		// the first node with a uuid keeps it
+		slot = uuid_find(kt, uuid);
+		if (slot->group != NULL) continue;
+		slot->group = it.group;
+		slot->entry = it.event == CX9R_KT_ITER_ENTRY ? it.entry : NULL;
+	}
+	return 1;
+}
+
+int cx9r_key_tree_find_uuid(cx9r_key_tree *kt, uint8_t const *uuid,
+		cx9r_kt_group **group, cx9r_kt_entry **entry) {
+	cx9r_kt_uuid_slot *slot;
+
+	*group = NULL;
+	*entry = NULL;
+	if (memcmp(uuid, no_uuid, CX9R_UUID_LENGTH) == 0) {
+		return 0;
+	}
+	if (kt->uuid_slots == NULL && !cx9r_key_tree_index_uuids(kt)) {
+		return 0;
+	}
+	slot = uuid_find(kt, uuid);
+	if (slot->group == NULL) {
+		return 0;
+	}
+	*group = slot->group;
+	*entry = slot->entry;
+	return 1;
 }
 
 cx9r_kt_group *cx9r_kt_group_get_parent(cx9r_kt_group const *ktg) {
@@ -123,16 +292,23 @@ char const *cx9r_kt_group_get_name(cx9r_kt_group const *ktg) {
 }
 
 char const *cx9r_kt_group_set_name(cx9r_kt_group *ktg, char const *name, size_t length) {
-	if (ktg->name != NULL) {
-		free(ktg->name);
-		ktg->name = NULL;
-	}
-	ktg->name = malloc(length + 1);
+	cx9r_kt_iter it;
+	size_t old_length = ktg->name != NULL ? strlen(ktg->name) : 0;
+
+	// a previous name stays in the arena until the tree is freed
+	ktg->name = cx9r_arena_strndup(&ktg->tree->arena, name, length);
 	if (ktg->name == NULL) {
-		return NULL;
+		length = 0;
+	}
+	// the paths of this group and all below it change length; the root
+	// is not part of any path, and groups are mostly named before they
+	// have children
+	if (ktg->parent != NULL && length != old_length) {
+		cx9r_kt_iter_init(&it, ktg, 0);
+		while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) {
+			it.group->path_length += length - old_length;
+		}
 	}
-	strncpy(ktg->name, name, length);
-	ktg->name[length] = 0;
 	return ktg->name;
 }
 
@@ -140,58 +316,251 @@ char const *cx9r_kt_group_set_zname(cx9r_kt_group *ktg, char const *name) {
 	return cx9r_kt_group_set_name(ktg, name, strlen(name));
 }
 
-cx9r_kt_group *cx9r_kt_group_add_child(cx9r_kt_group *ktg) {
-	cx9r_kt_group *c;
-	cx9r_kt_group **slot;
+int cx9r_kt_group_get_depth(cx9r_kt_group const *ktg) {
+	return ktg->depth;
+}
 
-	// find the slot to fill with a newly allocated group
-	if (ktg->children == NULL) {
-		slot = &ktg->children;
-	}
-	else {
-		c = ktg->children;
-		while (c->next != NULL) c = c->next;
-		slot = &c->next;
+uint8_t const *cx9r_kt_group_get_uuid(cx9r_kt_group const *ktg) {
+	return ktg->uuid;
+}
+
+void cx9r_kt_group_set_uuid(cx9r_kt_group *ktg, uint8_t const *uuid) {
+	memcpy(ktg->uuid, uuid, CX9R_UUID_LENGTH);
+	uuid_index_invalidate(ktg->tree);
+}
+
+size_t cx9r_kt_group_get_path_length(cx9r_kt_group const *ktg) {
+	return ktg->path_length;
+}
+
+char *cx9r_kt_group_get_path(cx9r_kt_group const *ktg, char *path) {
+	cx9r_kt_group const *g;
+	char *p = path + ktg->path_length;
+	size_t n;
+
+	// fill the names in from the end, walking up to the root once
+	*p = 0;
+	for (g = ktg; g->parent != NULL; g = g->parent) {
+		n = g->name != NULL ? strlen(g->name) : 0;
+		p -= n;
+		if (n > 0) memcpy(p, g->name, n);
+		if (p != path) *--p = '/';
 	}
+	return path;
+}
 
-	if ((c = malloc(sizeof(cx9r_kt_group))) == NULL) {
+cx9r_kt_group *cx9r_kt_group_add_child(cx9r_kt_group *ktg) {
+	cx9r_kt_group *c;
+
+	if ((c = cx9r_arena_alloc(&ktg->tree->arena, sizeof(cx9r_kt_group))) == NULL) {
 		return NULL;
 	}
 
+	c->tree = ktg->tree;
+	c->depth = ktg->depth + 1;
+	c->path_length = ktg->parent != NULL ? ktg->path_length + 1 : 0;
 	c->parent = ktg;
 	c->children = NULL;
 	c->entries = NULL;
 	c->next = NULL;
 	c->name = NULL;
-	*slot = c;
+	memset(c->uuid, 0, CX9R_UUID_LENGTH);
+	c->children_tail = NULL;
+	c->entries_tail = NULL;
+	c->n_children = 0;
+	c->n_entries = 0;
+	c->child_index = NULL;
+	c->entry_index = NULL;
+	c->n_child_indexed = 0;
+	c->n_entry_indexed = 0;
+	c->child_index_capacity = 0;
+	c->entry_index_capacity = 0;
+
+	// append to the list of children
+	if (ktg->children_tail == NULL) {
+		ktg->children = c;
+	}
+	else {
+		ktg->children_tail->next = c;
+	}
+	ktg->children_tail = c;
+	if (ktg->n_child_indexed == ktg->n_children
+			&& ktg->n_child_indexed < ktg->child_index_capacity) {
+		ktg->child_index[ktg->n_child_indexed++] = c;
+	}
+	ktg->n_children++;
+	uuid_index_invalidate(ktg->tree);
 	return c;
 }
 
 cx9r_kt_entry *cx9r_kt_group_add_entry(cx9r_kt_group *ktg) {
 	cx9r_kt_entry *e;
-	cx9r_kt_entry **slot;
-
-	//find the slot to fill with the newly allocated entry
-	if (ktg->entries == NULL) {
-		slot = &ktg->entries;
-	}
-	else {
-		e = ktg->entries;
-		while (e->next != NULL) e = e->next;
-		slot = &e->next;
-	}
 
-	if ((e = malloc(sizeof(cx9r_kt_entry))) == NULL) {
+	if ((e = cx9r_arena_alloc(&ktg->tree->arena, sizeof(cx9r_kt_entry))) == NULL) {
 		return NULL;
 	}
 
+	e->tree = ktg->tree;
 	e->next = NULL;
 	e->fields = NULL;
+	e->fields_tail = NULL;
+	memset(e->std_fields, 0, sizeof(e->std_fields));
 	e->name = NULL;
-	*slot = e;
+	memset(e->uuid, 0, CX9R_UUID_LENGTH);
+
+	// append to the list of entries
+	if (ktg->entries_tail == NULL) {
+		ktg->entries = e;
+	}
+	else {
+		ktg->entries_tail->next = e;
+	}
+	ktg->entries_tail = e;
+	if (ktg->n_entry_indexed == ktg->n_entries
+			&& ktg->n_entry_indexed < ktg->entry_index_capacity) {
+		ktg->entry_index[ktg->n_entry_indexed++] = e;
+	}
+	ktg->n_entries++;
+	uuid_index_invalidate(ktg->tree);
 	return e;
 }
 
+size_t cx9r_kt_group_child_count(cx9r_kt_group const *ktg) {
+	return ktg->n_children;
+}
+
+cx9r_kt_group *cx9r_kt_group_get_child(cx9r_kt_group *ktg, size_t i) {
+	cx9r_kt_group **index;
+	cx9r_kt_group *c;
+	size_t capacity;
+
+	if (i >= ktg->n_children) {
+		return NULL;
+	}
+	if (ktg->n_child_indexed < ktg->n_children) {
+		if (ktg->child_index_capacity < ktg->n_children) {
+			// the index lives in the arena; growing it geometrically bounds
+			// what the abandoned ones add up to
+			capacity = ktg->child_index_capacity * 2;
+			if (capacity < ktg->n_children) capacity = ktg->n_children;
+			index = cx9r_arena_alloc(&ktg->tree->arena,
+					capacity * sizeof(cx9r_kt_group*));
+			if (index == NULL) {
+				return NULL;
+			}
+			if (ktg->n_child_indexed > 0) {
+				memcpy(index, ktg->child_index,
+						ktg->n_child_indexed * sizeof(cx9r_kt_group*));
+			}
+			ktg->child_index = index;
+			ktg->child_index_capacity = capacity;
+		}
+		c = ktg->n_child_indexed > 0
+				? ktg->child_index[ktg->n_child_indexed - 1]->next : ktg->children;
+		for (; c != NULL; c = c->next) {
+			ktg->child_index[ktg->n_child_indexed++] = c;
+		}
+	}
+	return ktg->child_index[i];
+}
+
+size_t cx9r_kt_group_entry_count(cx9r_kt_group const *ktg) {
+	return ktg->n_entries;
+}
+
+cx9r_kt_entry *cx9r_kt_group_get_entry(cx9r_kt_group *ktg, size_t i) {
+	cx9r_kt_entry **index;
+	cx9r_kt_entry *e;
+	size_t capacity;
+
+	if (i >= ktg->n_entries) {
+		return NULL;
+	}
+	if (ktg->n_entry_indexed < ktg->n_entries) {
+		if (ktg->entry_index_capacity < ktg->n_entries) {
+			capacity = ktg->entry_index_capacity * 2;
+			if (capacity < ktg->n_entries) capacity = ktg->n_entries;
+			index = cx9r_arena_alloc(&ktg->tree->arena,
+					capacity * sizeof(cx9r_kt_entry*));
+			if (index == NULL) {
+				return NULL;
+			}
+			if (ktg->n_entry_indexed > 0) {
+				memcpy(index, ktg->entry_index,
+						ktg->n_entry_indexed * sizeof(cx9r_kt_entry*));
+			}
+			ktg->entry_index = index;
+			ktg->entry_index_capacity = capacity;
+		}
+		e = ktg->n_entry_indexed > 0
+				? ktg->entry_index[ktg->n_entry_indexed - 1]->next : ktg->entries;
+		for (; e != NULL; e = e->next) {
+			ktg->entry_index[ktg->n_entry_indexed++] = e;
+		}
+	}
+	return ktg->entry_index[i];
+}
+
+cx9r_kt_group *cx9r_kt_group_copy(cx9r_kt_group *parent, cx9r_kt_group const *src) {
+	cx9r_kt_iter it;
+	cx9r_kt_group *copy = NULL;
+	cx9r_kt_group *g = parent;
+	cx9r_kt_entry *e = NULL;
+	cx9r_kt_field *f;
+	int depth = -1;
+
+	// iterative, as trees may be nested deeper than the stack allows
+	cx9r_kt_iter_init(&it, (cx9r_kt_group*)src, CX9R_KT_ITER_FIELDS);
+	for (;;) {
+		switch (cx9r_kt_iter_next(&it)) {
+		case CX9R_KT_ITER_GROUP:
+			for (; depth >= it.depth; depth--) {
+				g = g->parent;
+			}
+			if ((g = cx9r_kt_group_add_child(g)) == NULL) {
+				return NULL;
+			}
+			depth = it.depth;
+			if (copy == NULL) {
+				copy = g;
+			}
+			if (it.group->name != NULL
+					&& cx9r_kt_group_set_zname(g, it.group->name) == NULL) {
+				return NULL;
+			}
+			cx9r_kt_group_set_uuid(g, it.group->uuid);
+			break;
+		case CX9R_KT_ITER_ENTRY:
+			if ((e = cx9r_kt_group_add_entry(g)) == NULL) {
+				return NULL;
+			}
+			if (it.entry->name != NULL
+					&& cx9r_kt_entry_set_zname(e, it.entry->name) == NULL) {
+				return NULL;
+			}
+			cx9r_kt_entry_set_uuid(e, it.entry->uuid);
+			break;
+		case CX9R_KT_ITER_FIELD:
+			// names are interned again, field ids differ between trees
+			if ((f = cx9r_kt_entry_add_field(e)) == NULL) {
+				return NULL;
+			}
+			if (it.field->name != NULL
+					&& cx9r_kt_field_set_zname(f, it.field->name) == NULL) {
+				return NULL;
+			}
+			if (it.field->value != NULL
+					&& cx9r_kt_field_set_zvalue(f, it.field->value) == NULL) {
+				return NULL;
+			}
+			f->protected = it.field->protected;
+			break;
+		default:
+			return copy;
+		}
+	}
+}
+
 char const *cx9r_kt_entry_get_name(cx9r_kt_entry *kte) {
 	return kte->name;
 }
@@ -201,16 +570,7 @@ char const *cx9r_kt_entry_set_name(cx9r_kt_entry *kte, char const *name, int len
 		length = strlen(name);
 	}
 
-	if (kte->name != NULL) {
-		free(kte->name);
-		kte->name = NULL;
-	}
-	kte->name = malloc(length + 1);
-	if (kte->name == NULL) {
-		return NULL;
-	}
-	strncpy(kte->name, name, length);
-	kte->name[length] = 0;
+	kte->name = cx9r_arena_strndup(&kte->tree->arena, name, length);
 	return kte->name;
 }
 
@@ -218,35 +578,68 @@ char const *cx9r_kt_entry_set_zname(cx9r_kt_entry *kte, char const *name) {
 	return cx9r_kt_entry_set_name(kte, name, strlen(name));
 }
 
+uint8_t const *cx9r_kt_entry_get_uuid(cx9r_kt_entry const *kte) {
+	return kte->uuid;
+}
+
+void cx9r_kt_entry_set_uuid(cx9r_kt_entry *kte, uint8_t const *uuid) {
+	memcpy(kte->uuid, uuid, CX9R_UUID_LENGTH);
+	uuid_index_invalidate(kte->tree);
+}
+
 cx9r_kt_field *cx9r_kt_entry_get_fields(cx9r_kt_entry *kte) {
 	return kte->fields;
 }
 
 cx9r_kt_field *cx9r_kt_entry_add_field(cx9r_kt_entry *kte) {
 	cx9r_kt_field *f;
-	cx9r_kt_field **slot;
 
-	//find the slot to fill with the newly allocated entry
-	if (kte->fields == NULL) {
-		slot = &kte->fields;
-	} else {
-		f = kte->fields;
-		while (f->next != NULL)
-			f = f->next;
-		slot = &f->next;
-	}
-
-	if ((f = malloc(sizeof(cx9r_kt_field))) == NULL) {
+	if ((f = cx9r_arena_alloc(&kte->tree->arena, sizeof(cx9r_kt_field))) == NULL) {
 		return NULL;
 	}
 
+	f->entry = kte;
 	f->name = NULL;
+	f->id = CX9R_FIELD_NONE;
+	f->protected = 0;
 	f->next = NULL;
 	f->value = NULL;
-	*slot = f;
+
+	// append to the list of fields
+	if (kte->fields_tail == NULL) {
+		kte->fields = f;
+	} else {
+		kte->fields_tail->next = f;
+	}
+	kte->fields_tail = f;
 	return f;
 }
 
+cx9r_kt_field *cx9r_kt_entry_get_field(cx9r_kt_entry *kte, int id) {
+	cx9r_kt_field *f;
+
+	if (id < 0) {
+		return NULL;
+	}
+	if (id < CX9R_N_STD_FIELDS) {
+		return kte->std_fields[id];
+	}
+	for (f = kte->fields; f != NULL; f = f->next) {
+		if (f->id == id) return f;
+	}
+	return NULL;
+}
+
+char const *cx9r_kt_entry_get_value(cx9r_kt_entry *kte, int id) {
+	cx9r_kt_field *f;
+
+	if (id == CX9R_FIELD_TITLE) {
+		return kte->name;
+	}
+	f = cx9r_kt_entry_get_field(kte, id);
+	return f != NULL ? f->value : NULL;
+}
+
 cx9r_kt_entry *cx9r_kt_entry_get_next(cx9r_kt_entry *kte) {
 	return kte->next;
 }
@@ -255,20 +648,40 @@ char const *cx9r_kt_field_get_name(cx9r_kt_field *ktf) {
 	return ktf->name;
 }
 
+// find the first field after ktf with a standard name id
+static cx9r_kt_field *next_with_id(cx9r_kt_field *ktf, int id) {
+	while ((ktf = ktf->next) != NULL && ktf->id != id);
+	return ktf;
+}
+
 char const *cx9r_kt_field_set_name(cx9r_kt_field *ktf, char const *name, size_t length) {
-	if (ktf->name != NULL) {
-		free(ktf->name);
-		ktf->name = NULL;
-	}
-	ktf->name = malloc(length + 1);
-	if (ktf->name == NULL) {
+	cx9r_kt_entry *e = ktf->entry;
+	cx9r_kt_field *f;
+	int id;
+
+	if ((id = cx9r_key_tree_intern(e->tree, name, length)) == CX9R_FIELD_NONE) {
 		return NULL;
 	}
-	strncpy(ktf->name, name, length);
-	ktf->name[length] = 0;
+
+	// keep the standard field slots pointing to the first field of each name
+	if (ktf->id >= 0 && ktf->id < CX9R_N_STD_FIELDS
+			&& e->std_fields[ktf->id] == ktf) {
+		e->std_fields[ktf->id] = next_with_id(ktf, ktf->id);
+	}
+	if (id < CX9R_N_STD_FIELDS) {
+		for (f = e->fields; f != ktf && f->id != id; f = f->next);
+		if (f == ktf) e->std_fields[id] = ktf;
+	}
+
+	ktf->id = id;
+	ktf->name = e->tree->atoms.names[id];
 	return ktf->name;
 }
 
+int cx9r_kt_field_get_id(cx9r_kt_field const *ktf) {
+	return ktf->id;
+}
+
 char const *cx9r_kt_field_set_zname(cx9r_kt_field *ktf, char const *name) {
 	return cx9r_kt_field_set_name(ktf, name, strlen(name));
 }
@@ -278,16 +691,7 @@ char const *cx9r_kt_field_get_value(cx9r_kt_field *ktf) {
 }
 
 char const *cx9r_kt_field_set_value(cx9r_kt_field *ktf, char const *value, size_t length) {
-	if (ktf->value != NULL) {
-		free(ktf->value);
-		ktf->value = NULL;
-	}
-	ktf->value = malloc(length + 1);
-	if (ktf->value == NULL) {
-		return NULL;
-	}
-	strncpy(ktf->value, value, length);
-	ktf->value[length] = 0;
+	ktf->value = cx9r_arena_strndup(&ktf->entry->tree->arena, value, length);
 	return ktf->value;
 }
 
@@ -295,60 +699,123 @@ char const *cx9r_kt_field_set_zvalue(cx9r_kt_field *ktf, char const *value) {
 	return cx9r_kt_field_set_value(ktf, value, strlen(value));
 }
 
-cx9r_kt_field *cx9r_kt_field_get_next(cx9r_kt_field *ktf) {
-	return ktf->next;
+int cx9r_kt_field_is_protected(cx9r_kt_field const *ktf) {
+	return ktf->protected;
 }
 
-static void print_spaces(int n) {
-	while (n--) {
-		putchar(' ');
-	}
+void cx9r_kt_field_set_protected(cx9r_kt_field *ktf, int protected) {
+	ktf->protected = protected;
 }
 
-static char const empty_string[] = "";
-
-static void dump_field(cx9r_kt_field *f, int depth) {
-	print_spaces(depth);
-	printf("field: ");
-	if (f->name != NULL) printf("%s", f->name);
-	printf(" - ");
-	if (f->value != NULL) printf("%s", f->value);
-	printf("\n");
-	if (f->next != NULL) {
-		dump_field(f->next, depth);
-	}
+cx9r_kt_field *cx9r_kt_field_get_next(cx9r_kt_field *ktf) {
+	return ktf->next;
 }
 
-static void dump_entry(cx9r_kt_entry *e, int depth)	{
-	print_spaces(depth);
-	printf("entry: ");
-	if (e->name != NULL) printf("%s", e->name);
-	printf("\n");
-	if (e->fields != NULL) {
-		dump_field(e->fields, depth + 1);
-	}
-	if (e->next != NULL) {
-		dump_entry(e->next, depth);
+void cx9r_kt_iter_init(cx9r_kt_iter *it, cx9r_kt_group *start, int flags) {
+	it->start = start;
+	it->group = NULL;
+	it->entry = NULL;
+	it->field = NULL;
+	// fields are only reached through their entries
+	it->flags = flags & CX9R_KT_ITER_FIELDS ? flags | CX9R_KT_ITER_ENTRIES : flags;
+	it->event = CX9R_KT_ITER_END;
+	it->group_depth = 0;
+	it->depth = 0;
+}
+
+int cx9r_kt_iter_next(cx9r_kt_iter *it) {
+	cx9r_kt_group *g = it->group;
+
+	switch (it->event) {
+	case CX9R_KT_ITER_END:
+		if (g != NULL) {
+			// already finished
+			return CX9R_KT_ITER_END;
+		}
+		it->group = it->start;
+		it->depth = 0;
+		return it->event = CX9R_KT_ITER_GROUP;
+
+	case CX9R_KT_ITER_FIELD:
+		if ((it->field = it->field->next) != NULL) {
+			return CX9R_KT_ITER_FIELD;
+		}
+		goto next_entry;
+
+	case CX9R_KT_ITER_ENTRY:
+		if (it->flags & CX9R_KT_ITER_FIELDS && it->entry->fields != NULL) {
+			it->field = it->entry->fields;
+			it->depth = it->group_depth + 2;
+			return it->event = CX9R_KT_ITER_FIELD;
+		}
+	next_entry:
+		if ((it->entry = it->entry->next) != NULL) {
+			it->depth = it->group_depth + 1;
+			return it->event = CX9R_KT_ITER_ENTRY;
+		}
+		goto next_group;
+
+	case CX9R_KT_ITER_GROUP:
+		if (it->flags & CX9R_KT_ITER_ENTRIES && g->entries != NULL) {
+			it->entry = g->entries;
+			it->depth = it->group_depth + 1;
+			return it->event = CX9R_KT_ITER_ENTRY;
+		}
+	next_group:
+		if (g->children != NULL) {
+			g = g->children;
+			it->group_depth++;
+		}
+		else {
+			// climb until a group with a next sibling is found
+			while (g != it->start && g->next == NULL) {
+				g = g->parent;
+				it->group_depth--;
+			}
+			if (g == it->start) {
+				it->entry = NULL;
+				it->field = NULL;
+				return it->event = CX9R_KT_ITER_END;
+			}
+			g = g->next;
+		}
+		it->group = g;
+		it->depth = it->group_depth;
+		return it->event = CX9R_KT_ITER_GROUP;
 	}
+	return CX9R_KT_ITER_END;
 }
 
-static void dump_group(cx9r_kt_group *g, int depth) {
-	print_spaces(depth);
-	printf("group: ");
-	if (g->name != NULL) printf("%s", g->name);
-	printf("\n");
-	if (g->entries != NULL) {
-		dump_entry(g->entries, depth + 1);
-	}
-	if (g->next != NULL) {
-		dump_group(g->next, depth);
-	}
-	if (g->children != NULL) {
-		dump_group(g->children, depth + 1);
+static void print_spaces(int n) {
+	while (n--) {
+		putchar(' ');
 	}
 }
 
 void cx9r_dump_tree(cx9r_key_tree *kt) {
+	cx9r_kt_iter it;
+	int event;
+
 	printf("top\n");
-	dump_group(&kt->root, 1);
+	cx9r_kt_iter_init(&it, &kt->root, CX9R_KT_ITER_FIELDS);
+	while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		print_spaces(it.depth + 1);
+		switch (event) {
+		case CX9R_KT_ITER_GROUP:
+			printf("group: ");
+			if (it.group->name != NULL) printf("%s", it.group->name);
+			break;
+		case CX9R_KT_ITER_ENTRY:
+			printf("entry: ");
+			if (it.entry->name != NULL) printf("%s", it.entry->name);
+			break;
+		case CX9R_KT_ITER_FIELD:
+			printf("field: ");
+			if (it.field->name != NULL) printf("%s", it.field->name);
+			printf(" - ");
+			if (it.field->value != NULL) printf("%s", it.field->value);
+			break;
+		}
+		printf("\n");
+	}
 }
@@ -21,6 +21,11 @@
 #define CX9R_KEY_TREE_H
 
 #include <stdlib.h>
+#include <stdint.h>
+#include "arena.h"
+
+// length of the binary form of a KDBX UUID
+#define CX9R_UUID_LENGTH 16
 
 typedef struct cx9r_ktf cx9r_kt_field;
 
@@ -30,33 +35,150 @@ typedef struct cx9r_ktg cx9r_kt_group;
 
 typedef struct cx9r_kt cx9r_key_tree;
 
+// ids of interned field names; the standard KDBX keys are predefined,
+// other names get consecutive ids from CX9R_N_STD_FIELDS on
+enum cx9r_kt_field_id_enum {
+	CX9R_FIELD_TITLE,
+	CX9R_FIELD_USERNAME,
+	CX9R_FIELD_PASSWORD,
+	CX9R_FIELD_URL,
+	CX9R_FIELD_NOTES,
+	CX9R_N_STD_FIELDS
+};
+
+#define CX9R_FIELD_NONE (-1)
+
+// table of interned field names
+typedef struct {
+	char const **names;	// name of each id
+	int *slots;			// open addressing hash table of ids, -1 if empty
+	size_t n_names;
+	size_t names_capacity;
+	size_t slots_capacity;	// power of two
+} cx9r_kt_atoms;
+
+// all nodes and strings of a key tree are allocated from the arena of the
+// tree, which every node can reach through its tree (or entry) pointer
 struct cx9r_ktf {
-	char *name;
+	cx9r_kt_entry *entry;
+	char const *name;	// interned, shared with all fields of the same name
+	int id;				// id of the interned name
+	int protected;		// value was stored in memory protected form
 	char *value;
 	cx9r_kt_field *next;
 };
 
 struct cx9r_kte {
+	cx9r_key_tree *tree;
 	char *name;
 	cx9r_kt_field *fields;
+	cx9r_kt_field *fields_tail;
+	// first field of each standard name, also kept in the list of fields;
+	// the title is stored as the entry name
+	cx9r_kt_field *std_fields[CX9R_N_STD_FIELDS];
+	uint8_t uuid[CX9R_UUID_LENGTH];	// all zero if the entry has none
 	cx9r_kt_entry *next;
 };
 
 struct cx9r_ktg {
+	cx9r_key_tree *tree;
 	char *name;
+	uint8_t uuid[CX9R_UUID_LENGTH];	// all zero if the group has none
+	int depth;			// 0 for the root
+	// length of the names from below the root down to this group, joined
+	// by '/'; set when the group is added or a group above is renamed,
+	// the names themselves are shared through the parents
+	size_t path_length;
 	cx9r_kt_group *parent;
 	cx9r_kt_group *children;
 	cx9r_kt_group *next;
 	cx9r_kt_entry *entries;
+	// last elements of the lists, for appending in constant time
+	cx9r_kt_group *children_tail;
+	cx9r_kt_entry *entries_tail;
+	size_t n_children;
+	size_t n_entries;
+	// arrays for indexed access, built on demand and kept up to date by
+	// appends while they have room; the first n_*_indexed slots are valid
+	cx9r_kt_group **child_index;
+	cx9r_kt_entry **entry_index;
+	size_t n_child_indexed;
+	size_t n_entry_indexed;
+	size_t child_index_capacity;
+	size_t entry_index_capacity;
 };
 
+// slot of the uuid index: an entry together with its group, or a group
+// alone; both are NULL in an empty slot
+typedef struct {
+	cx9r_kt_group *group;
+	cx9r_kt_entry *entry;
+} cx9r_kt_uuid_slot;
+
 struct cx9r_kt {
 	cx9r_kt_group root;
+	cx9r_arena arena;
+	cx9r_kt_atoms atoms;
+	// open addressing hash table of all nodes with a uuid, built on
+	// demand; NULL when not built or when nodes or uuids changed since
+	cx9r_kt_uuid_slot *uuid_slots;
+	size_t uuid_capacity;	// power of two
 };
 
+// events reported by a tree iterator
+enum cx9r_kt_iter_event_enum {
+	CX9R_KT_ITER_END,
+	CX9R_KT_ITER_GROUP,
+	CX9R_KT_ITER_ENTRY,
+	CX9R_KT_ITER_FIELD
+};
+
+// flags selecting the nodes an iterator visits besides groups
+#define CX9R_KT_ITER_ENTRIES 1
+#define CX9R_KT_ITER_FIELDS 2
+
+/// Pre-order iterator over a subtree: a group is followed by its entries,
+/// each entry by its fields, and then by its child groups. The path back
+/// up is taken through the parent pointers, so the iterator needs constant
+/// space however deep or wide the tree is.
+typedef struct {
+	cx9r_kt_group *start;
+	cx9r_kt_group *group;	// current group, or group of the current entry
+	cx9r_kt_entry *entry;	// current entry, or entry of the current field
+	cx9r_kt_field *field;	// current field
+	int flags;
+	int event;				// last event returned
+	int group_depth;		// depth of group below start
+	int depth;				// depth of the current node below start
+} cx9r_kt_iter;
+
 cx9r_key_tree *cx9r_key_tree_create();
 cx9r_kt_group *cx9r_key_tree_get_root(cx9r_key_tree *kt);
 void cx9r_key_tree_free(cx9r_key_tree *kt);
+int cx9r_key_tree_intern(cx9r_key_tree *kt, char const *name, size_t length);
+int cx9r_key_tree_lookup_field_id(cx9r_key_tree const *kt, char const *name);
+char const *cx9r_key_tree_get_field_name(cx9r_key_tree const *kt, int id);
+
+/**
+ * Build the uuid index of a tree, replacing an outdated one. Lookups
+ * build it on demand, so calling this is only needed to pay the cost
+ * up front, e.g. when loading ends.
+ * @param kt key tree
+ * @return 1 on success, 0 if allocation failed
+ */
+int cx9r_key_tree_index_uuids(cx9r_key_tree *kt);
+
+/**
+ * Find the group or entry with a uuid. If several nodes share the uuid,
+ * the first one in tree order is found.
+ * @param kt key tree
+ * @param uuid CX9R_UUID_LENGTH bytes, not all zero
+ * @param group set to the group found, or to the group of the entry found
+ * @param entry set to the entry found, or to NULL if a group was found
+ * @return 1 if found, 0 if not found or the index could not be built
+ */
+int cx9r_key_tree_find_uuid(cx9r_key_tree *kt, uint8_t const *uuid,
+		cx9r_kt_group **group, cx9r_kt_entry **entry);
 
 cx9r_kt_group *cx9r_kt_group_get_parent(cx9r_kt_group const *ktg);
 cx9r_kt_group *cx9r_kt_group_get_children(cx9r_kt_group const *ktg);
@@ -65,24 +187,80 @@ cx9r_kt_entry *cx9r_kt_group_get_entries(cx9r_kt_group const *ktg);
 char const *cx9r_kt_group_get_name(cx9r_kt_group const *ktg);
 char const *cx9r_kt_group_set_name(cx9r_kt_group *ktg, char const *name, size_t length);
 char const *cx9r_kt_group_set_zname(cx9r_kt_group *ktg, char const *name);
+int cx9r_kt_group_get_depth(cx9r_kt_group const *ktg);
+uint8_t const *cx9r_kt_group_get_uuid(cx9r_kt_group const *ktg);
+void cx9r_kt_group_set_uuid(cx9r_kt_group *ktg, uint8_t const *uuid);
+
+/**
+ * Get the length of the path of a group, see cx9r_kt_group_get_path().
+ * @param ktg group
+ * @return length of the path without the terminating zero
+ */
+size_t cx9r_kt_group_get_path_length(cx9r_kt_group const *ktg);
+
+/**
+ * Write the path of a group: the names of the groups from below the root
+ * down to this one, joined by '/', an unnamed group giving an empty name.
+ * The tree is not changed, so paths can be written from several threads.
+ * @param ktg group
+ * @param path buffer of at least cx9r_kt_group_get_path_length() + 1 bytes
+ * @return path
+ */
+char *cx9r_kt_group_get_path(cx9r_kt_group const *ktg, char *path);
 cx9r_kt_group *cx9r_kt_group_add_child(cx9r_kt_group *ktg);
 cx9r_kt_entry *cx9r_kt_group_add_entry(cx9r_kt_group *ktg);
+size_t cx9r_kt_group_child_count(cx9r_kt_group const *ktg);
+cx9r_kt_group *cx9r_kt_group_get_child(cx9r_kt_group *ktg, size_t i);
+size_t cx9r_kt_group_entry_count(cx9r_kt_group const *ktg);
+cx9r_kt_entry *cx9r_kt_group_get_entry(cx9r_kt_group *ktg, size_t i);
+
+/**
+ * Copy a group with its entries, fields and descendants, possibly from
+ * another tree, and add the copy as the last child of a group.
+ * @param parent group to add the copy to
+ * @param src group to copy
+ * @return the copy, or NULL if allocation failed (a partial copy is
+ * left in the tree then)
+ */
+cx9r_kt_group *cx9r_kt_group_copy(cx9r_kt_group *parent, cx9r_kt_group const *src);
 
 char const *cx9r_kt_entry_get_name(cx9r_kt_entry *kte);
 char const *cx9r_kt_entry_set_name(cx9r_kt_entry *kte, char const *name, int length);
 char const *cx9r_kt_entry_set_zname(cx9r_kt_entry *kte, char const *name);
+uint8_t const *cx9r_kt_entry_get_uuid(cx9r_kt_entry const *kte);
+void cx9r_kt_entry_set_uuid(cx9r_kt_entry *kte, uint8_t const *uuid);
 cx9r_kt_field *cx9r_kt_entry_get_fields(cx9r_kt_entry *kte);
 cx9r_kt_field *cx9r_kt_entry_add_field(cx9r_kt_entry *kte);
+cx9r_kt_field *cx9r_kt_entry_get_field(cx9r_kt_entry *kte, int id);
+char const *cx9r_kt_entry_get_value(cx9r_kt_entry *kte, int id);
 cx9r_kt_entry *cx9r_kt_entry_get_next(cx9r_kt_entry *kte);
 
 char const *cx9r_kt_field_get_name(cx9r_kt_field *ktf);
+int cx9r_kt_field_get_id(cx9r_kt_field const *ktf);
 char const *cx9r_kt_field_set_name(cx9r_kt_field *ktf, char const *name, size_t length);
 char const *cx9r_kt_field_set_zname(cx9r_kt_field *ktf, char const *name);
 char const *cx9r_kt_field_get_value(cx9r_kt_field *ktf);
 char const *cx9r_kt_field_set_value(cx9r_kt_field *ktf, char const *value, size_t length);
 char const *cx9r_kt_field_set_zvalue(cx9r_kt_field *ktf, char const *value);
+int cx9r_kt_field_is_protected(cx9r_kt_field const *ktf);
+void cx9r_kt_field_set_protected(cx9r_kt_field *ktf, int protected);
 cx9r_kt_field *cx9r_kt_field_get_next(cx9r_kt_field *ktf);
 
+/**
+ * Initialize an iterator over a group and all its descendants.
+ * @param it iterator
+ * @param start group to start at, reported first with depth 0
+ * @param flags CX9R_KT_ITER_ENTRIES and/or CX9R_KT_ITER_FIELDS
+ */
+void cx9r_kt_iter_init(cx9r_kt_iter *it, cx9r_kt_group *start, int flags);
+
+/**
+ * Advance an iterator to the next node.
+ * @param it iterator
+ * @return event for the node now current, CX9R_KT_ITER_END when done
+ */
+int cx9r_kt_iter_next(cx9r_kt_iter *it);
+
 void cx9r_dump_tree(cx9r_key_tree *kt);
 
 
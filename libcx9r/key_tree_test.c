@@ -23,18 +23,43 @@
 #include <string.h>
 
 #define TEST_LENGTH 5
+#define N_APPENDED 1000
+#define LARGE_LENGTH (3 * CX9R_ARENA_CHUNK_SIZE)
+#define DEEP_LEVELS 100000
 
 static char const test1[] = "test1";
 static char const test2[] = "test2";
 
+// compare two possibly NULL strings
+static int same(char const *a, char const *b) {
+	return a == b || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
 int main() {
 
 	cx9r_key_tree *kt;
+	cx9r_key_tree *kt2;
 	cx9r_kt_group *g;
 	cx9r_kt_group *c;
 	cx9r_kt_entry *e;
 	cx9r_kt_field *f;
+	cx9r_kt_field *f2;
+	cx9r_kt_iter it;
+	cx9r_kt_iter it2;
+	cx9r_kt_group *found_group;
+	cx9r_kt_entry *found_entry;
+	uint8_t uuid[CX9R_UUID_LENGTH];
+	size_t n_groups;
+	size_t n_entries;
+	size_t n_fields;
+	size_t reserved;
+	size_t used;
+	size_t n_chunks;
 	char const *s;
+	char *big;
+	char name[16];
+	char path[16];
+	int i;
 
 	printf("creating key tree...");
 	kt = cx9r_key_tree_create();
@@ -120,6 +145,36 @@ int main() {
 	if (e != NULL) goto dealloc_tree;
 	printf("ok\n");
 
+	printf("indexed access...");
+	if (cx9r_kt_group_child_count(g) != 2) goto dealloc_tree;
+	if (cx9r_kt_group_entry_count(g) != 2) goto dealloc_tree;
+	if (cx9r_kt_group_get_child(g, 0) != cx9r_kt_group_get_children(g))
+		goto dealloc_tree;
+	if (strcmp(cx9r_kt_group_get_name(cx9r_kt_group_get_child(g, 1)), test2) != 0)
+		goto dealloc_tree;
+	if (cx9r_kt_group_get_child(g, 2) != NULL) goto dealloc_tree;
+	if (strcmp(cx9r_kt_entry_get_name(cx9r_kt_group_get_entry(g, 1)), test2) != 0)
+		goto dealloc_tree;
+	if (cx9r_kt_group_get_entry(g, 2) != NULL) goto dealloc_tree;
+	// appending must be reflected by an index that was already built, and
+	// alternating appends with reads must not keep rebuilding it
+	cx9r_arena_get_usage(&kt->arena, &reserved, &used, &n_chunks);
+	n_fields = used;
+	for (i = 0; i < N_APPENDED; i++) {
+		e = cx9r_kt_group_add_entry(g);
+		if (e == NULL) goto dealloc_tree;
+		if (cx9r_kt_group_get_entry(g, (size_t)i + 2) != e) goto dealloc_tree;
+	}
+	cx9r_arena_get_usage(&kt->arena, &reserved, &used, &n_chunks);
+	if (used - n_fields > N_APPENDED * (sizeof(cx9r_kt_entry)
+			+ 4 * sizeof(cx9r_kt_entry*))) goto dealloc_tree;
+	if (cx9r_kt_group_entry_count(g) != N_APPENDED + 2) goto dealloc_tree;
+	if (cx9r_kt_group_get_entry(g, N_APPENDED + 1) != e) goto dealloc_tree;
+	if (cx9r_kt_entry_get_next(e) != NULL) goto dealloc_tree;
+	if (strcmp(cx9r_kt_entry_get_name(cx9r_kt_group_get_entry(g, 0)), test1) != 0)
+		goto dealloc_tree;
+	printf("ok\n");
+
 	printf("creating fields...");
 	e = cx9r_kt_group_get_entries(g);
 	f = cx9r_kt_entry_get_fields(e);
@@ -171,10 +226,244 @@ int main() {
 	if (f != NULL) goto dealloc_tree;
 	printf("ok\n");
 
+	// field names are interned per tree
+	printf("interning field names...");
+	f = cx9r_kt_entry_add_field(e);
+	if (f == NULL) goto dealloc_tree;
+	if (cx9r_kt_field_set_zname(f, "Password") == NULL) goto dealloc_tree;
+	if (cx9r_kt_field_get_id(f) != CX9R_FIELD_PASSWORD) goto dealloc_tree;
+	if (cx9r_kt_entry_get_field(e, CX9R_FIELD_PASSWORD) != f) goto dealloc_tree;
+	if (cx9r_kt_entry_get_field(e, CX9R_FIELD_URL) != NULL) goto dealloc_tree;
+	if (cx9r_kt_entry_get_value(e, CX9R_FIELD_TITLE) != cx9r_kt_entry_get_name(e))
+		goto dealloc_tree;
+	if (cx9r_kt_entry_get_field(e, cx9r_key_tree_lookup_field_id(kt, test2))
+			!= cx9r_kt_field_get_next(cx9r_kt_entry_get_fields(e))) goto dealloc_tree;
+	// the standard slot holds the first field of a name
+	f2 = cx9r_kt_entry_add_field(e);
+	if (f2 == NULL) goto dealloc_tree;
+	if (cx9r_kt_field_set_zname(f2, "Password") == NULL) goto dealloc_tree;
+	if (cx9r_kt_entry_get_field(e, CX9R_FIELD_PASSWORD) != f) goto dealloc_tree;
+	if (cx9r_kt_field_set_zname(f, "URL") == NULL) goto dealloc_tree;
+	if (cx9r_kt_entry_get_field(e, CX9R_FIELD_URL) != f) goto dealloc_tree;
+	if (cx9r_kt_entry_get_field(e, CX9R_FIELD_PASSWORD) != f2) goto dealloc_tree;
+	if (cx9r_kt_field_get_id(cx9r_kt_entry_get_fields(e))
+			!= cx9r_key_tree_lookup_field_id(kt, test1)) goto dealloc_tree;
+	if (cx9r_kt_field_get_id(cx9r_kt_entry_get_fields(e)) < CX9R_N_STD_FIELDS)
+		goto dealloc_tree;
+	if (cx9r_key_tree_lookup_field_id(kt, "test") != CX9R_FIELD_NONE)
+		goto dealloc_tree;
+	for (i = 0; i < N_APPENDED; i++) {
+		snprintf(name, sizeof(name), "custom%d", i);
+		if (cx9r_key_tree_intern(kt, name, strlen(name)) != CX9R_N_STD_FIELDS + 2 + i)
+			goto dealloc_tree;
+	}
+	if (cx9r_key_tree_intern(kt, name, strlen(name)) != CX9R_N_STD_FIELDS + 1 + i)
+		goto dealloc_tree;
+	if (cx9r_key_tree_intern(kt, "URLx", 3) != CX9R_FIELD_URL) goto dealloc_tree;
+	s = cx9r_key_tree_get_field_name(kt, CX9R_FIELD_USERNAME);
+	if (s == NULL || strcmp(s, "UserName") != 0) goto dealloc_tree;
+	if (cx9r_kt_field_get_name(f) != cx9r_key_tree_get_field_name(kt, CX9R_FIELD_URL))
+		goto dealloc_tree;
+	printf("ok\n");
+
+	// a value larger than an arena chunk must be stored intact
+	// without disturbing values allocated around it
+	printf("storing large values...");
+	if ((big = malloc(LARGE_LENGTH)) == NULL) goto dealloc_tree;
+	memset(big, 'x', LARGE_LENGTH);
+	f = cx9r_kt_entry_add_field(e);
+	if (f == NULL) goto dealloc_big;
+	s = cx9r_kt_field_set_value(f, big, LARGE_LENGTH);
+	if (s == NULL) goto dealloc_big;
+	f = cx9r_kt_entry_add_field(e);
+	if (f == NULL) goto dealloc_big;
+	if (cx9r_kt_field_set_zvalue(f, test1) == NULL) goto dealloc_big;
+	if (strlen(s) != LARGE_LENGTH || memcmp(s, big, LARGE_LENGTH) != 0)
+		goto dealloc_big;
+	if (strcmp(cx9r_kt_field_get_value(f), test1) != 0) goto dealloc_big;
+	free(big);
+	printf("ok\n");
+
+	printf("iterating the tree...");
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_FIELDS);
+	if (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_GROUP) goto dealloc_tree;
+	if (it.group != g || it.depth != 0) goto dealloc_tree;
+	if (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_ENTRY) goto dealloc_tree;
+	if (it.entry != e || it.depth != 1) goto dealloc_tree;
+	if (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_FIELD) goto dealloc_tree;
+	if (it.field != cx9r_kt_entry_get_fields(e) || it.depth != 2) goto dealloc_tree;
+	n_groups = 1;
+	n_entries = 1;
+	n_fields = 1;
+	for (;;) {
+		i = cx9r_kt_iter_next(&it);
+		if (i == CX9R_KT_ITER_END) break;
+		if (i == CX9R_KT_ITER_GROUP) {
+			if (it.depth != 1 || it.group != cx9r_kt_group_get_child(g, n_groups - 1))
+				goto dealloc_tree;
+			n_groups++;
+		}
+		if (i == CX9R_KT_ITER_ENTRY) {
+			// all entries precede the child groups
+			if (n_groups != 1) goto dealloc_tree;
+			n_entries++;
+		}
+		if (i == CX9R_KT_ITER_FIELD) n_fields++;
+	}
+	if (n_groups != 3 || n_entries != N_APPENDED + 2 || n_fields != 6)
+		goto dealloc_tree;
+	// the end is sticky
+	if (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) goto dealloc_tree;
+	// a subtree does not include the siblings of its top group
+	c = cx9r_kt_group_get_children(g);
+	cx9r_kt_iter_init(&it, c, CX9R_KT_ITER_ENTRIES);
+	if (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_GROUP || it.group != c)
+		goto dealloc_tree;
+	if (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) goto dealloc_tree;
+	// nesting depth is not limited by the call stack
+	c = cx9r_kt_group_get_child(g, 1);
+	for (i = 0; i < DEEP_LEVELS; i++) {
+		if ((c = cx9r_kt_group_add_child(c)) == NULL) goto dealloc_tree;
+	}
+	if ((e = cx9r_kt_group_add_entry(c)) == NULL) goto dealloc_tree;
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_ENTRIES);
+	n_groups = 0;
+	while ((i = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		if (i == CX9R_KT_ITER_GROUP) n_groups++;
+		if (i == CX9R_KT_ITER_ENTRY && it.entry == e
+				&& (it.group != c || it.depth != DEEP_LEVELS + 2)) goto dealloc_tree;
+	}
+	if (n_groups != DEEP_LEVELS + 3) goto dealloc_tree;
+	printf("ok\n");
+
+	printf("group paths...");
+	if (cx9r_kt_group_get_depth(g) != 0) goto dealloc_tree;
+	if (cx9r_kt_group_get_path_length(g) != 0
+			|| strcmp(cx9r_kt_group_get_path(g, path), "") != 0) goto dealloc_tree;
+	c = cx9r_kt_group_get_child(g, 1);
+	if (cx9r_kt_group_get_depth(c) != 1) goto dealloc_tree;
+	if ((c = cx9r_kt_group_add_child(c)) == NULL) goto dealloc_tree;
+	if (cx9r_kt_group_get_depth(c) != 2) goto dealloc_tree;
+	if (cx9r_kt_group_set_zname(c, "sub") == NULL) goto dealloc_tree;
+	if (cx9r_kt_group_get_path_length(c) != 9
+			|| strcmp(cx9r_kt_group_get_path(c, path), "test2/sub") != 0)
+		goto dealloc_tree;
+	// renaming a group above changes the path below
+	if (cx9r_kt_group_set_zname(cx9r_kt_group_get_parent(c), "renamed") == NULL)
+		goto dealloc_tree;
+	if (cx9r_kt_group_get_path_length(c) != 11
+			|| strcmp(cx9r_kt_group_get_path(c, path), "renamed/sub") != 0)
+		goto dealloc_tree;
+	// an unnamed group has an empty component
+	if ((c = cx9r_kt_group_add_child(c)) == NULL) goto dealloc_tree;
+	if (cx9r_kt_group_get_path_length(c) != 12
+			|| strcmp(cx9r_kt_group_get_path(c, path), "renamed/sub/") != 0)
+		goto dealloc_tree;
+	// and so does naming a group with children
+	if (cx9r_kt_group_set_zname(cx9r_kt_group_get_parent(c), "s") == NULL)
+		goto dealloc_tree;
+	if (cx9r_kt_group_get_path_length(c) != 10
+			|| strcmp(cx9r_kt_group_get_path(c, path), "renamed/s/") != 0)
+		goto dealloc_tree;
+	printf("ok\n");
+
+	printf("uuid lookup...");
+	// the all zero uuid means none and is never found
+	memset(uuid, 0, CX9R_UUID_LENGTH);
+	if (cx9r_key_tree_find_uuid(kt, uuid, &found_group, &found_entry))
+		goto dealloc_tree;
+	c = cx9r_kt_group_get_child(g, 0);
+	if ((e = cx9r_kt_group_add_entry(c)) == NULL) goto dealloc_tree;
+	uuid[0] = 1;
+	cx9r_kt_entry_set_uuid(e, uuid);
+	if (!cx9r_key_tree_find_uuid(kt, uuid, &found_group, &found_entry)
+			|| found_group != c || found_entry != e) goto dealloc_tree;
+	// of two nodes with the same uuid the first in tree order is found
+	c = cx9r_kt_group_get_child(g, 1);
+	if ((e = cx9r_kt_group_add_entry(c)) == NULL) goto dealloc_tree;
+	cx9r_kt_entry_set_uuid(e, uuid);
+	if (!cx9r_key_tree_find_uuid(kt, uuid, &found_group, &found_entry)
+			|| found_group != cx9r_kt_group_get_child(g, 0)) goto dealloc_tree;
+	uuid[0] = 2;
+	cx9r_kt_group_set_uuid(c, uuid);
+	if (!cx9r_key_tree_find_uuid(kt, uuid, &found_group, &found_entry)
+			|| found_group != c || found_entry != NULL) goto dealloc_tree;
+	if (memcmp(cx9r_kt_group_get_uuid(c), uuid, CX9R_UUID_LENGTH) != 0)
+		goto dealloc_tree;
+	// uuids differing only in the bytes after the hashed ones
+	uuid[0] = 3;
+	for (i = 0; i < N_APPENDED; i++) {
+		if ((e = cx9r_kt_group_add_entry(c)) == NULL) goto dealloc_tree;
+		uuid[14] = (uint8_t)i;
+		uuid[15] = (uint8_t)(i >> 8);
+		cx9r_kt_entry_set_uuid(e, uuid);
+	}
+	if (!cx9r_key_tree_index_uuids(kt)) goto dealloc_tree;
+	for (i = 0; i < N_APPENDED; i++) {
+		uuid[14] = (uint8_t)i;
+		uuid[15] = (uint8_t)(i >> 8);
+		if (!cx9r_key_tree_find_uuid(kt, uuid, &found_group, &found_entry)
+				|| memcmp(cx9r_kt_entry_get_uuid(found_entry), uuid,
+						CX9R_UUID_LENGTH) != 0) goto dealloc_tree;
+	}
+	uuid[0] = 4;
+	if (cx9r_key_tree_find_uuid(kt, uuid, &found_group, &found_entry))
+		goto dealloc_tree;
+	printf("ok\n");
+
+	printf("copying into another tree...");
+	kt2 = cx9r_key_tree_create();
+	if (kt2 == NULL) goto dealloc_tree;
+	c = cx9r_kt_group_copy(cx9r_key_tree_get_root(kt2), g);
+	if (c == NULL || cx9r_kt_group_get_depth(c) != 1) goto dealloc_trees;
+	// both subtrees must yield the same events and names in the same order
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_FIELDS);
+	cx9r_kt_iter_init(&it2, c, CX9R_KT_ITER_FIELDS);
+	do {
+		i = cx9r_kt_iter_next(&it);
+		if (cx9r_kt_iter_next(&it2) != i || it2.depth != it.depth)
+			goto dealloc_trees;
+		if (i == CX9R_KT_ITER_ENTRY && (!same(cx9r_kt_entry_get_name(it.entry),
+				cx9r_kt_entry_get_name(it2.entry))
+				|| memcmp(cx9r_kt_entry_get_uuid(it.entry),
+						cx9r_kt_entry_get_uuid(it2.entry), CX9R_UUID_LENGTH) != 0))
+			goto dealloc_trees;
+		if (i == CX9R_KT_ITER_FIELD && (!same(cx9r_kt_field_get_name(it.field),
+				cx9r_kt_field_get_name(it2.field))
+				|| !same(cx9r_kt_field_get_value(it.field),
+						cx9r_kt_field_get_value(it2.field))
+				|| cx9r_kt_field_is_protected(it.field)
+						!= cx9r_kt_field_is_protected(it2.field)
+				// field ids belong to the tree they were interned in
+				|| (cx9r_kt_field_get_name(it2.field) != NULL
+						&& cx9r_kt_field_get_id(it2.field)
+						!= cx9r_key_tree_lookup_field_id(kt2,
+								cx9r_kt_field_get_name(it2.field)))))
+			goto dealloc_trees;
+	} while (i != CX9R_KT_ITER_END);
+	uuid[0] = 2;
+	memset(uuid + 1, 0, CX9R_UUID_LENGTH - 1);
+	if (!cx9r_key_tree_index_uuids(kt2)
+			|| !cx9r_key_tree_find_uuid(kt2, uuid, &found_group, &found_entry)
+			|| found_entry != NULL || !same(cx9r_kt_group_get_name(found_group),
+					cx9r_kt_group_get_name(cx9r_kt_group_get_child(g, 1))))
+		goto dealloc_trees;
+	printf("ok\n");
+
+	cx9r_key_tree_free(kt2);
 	cx9r_key_tree_free(kt);
 
 	return 0;
 
+dealloc_trees:
+
+	cx9r_key_tree_free(kt2);
+	goto dealloc_tree;
+
+dealloc_big:
+
+	free(big);
+
 dealloc_tree:
 
 	cx9r_key_tree_free(kt);
@@ -0,0 +1,84 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mem_stats.h"
+#include <stdlib.h>
+#include <sys/resource.h>
+
+// each block starts with its size, padded to keep the payload aligned
+#define HEADER_SIZE 16
+
+static cx9r_mem_stats stats;
+
+// raise *p to at least v
+static void atomic_max(size_t *p, size_t v) {
+	size_t old = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+	while (v > old && !__atomic_compare_exchange_n(p, &old, v, 0,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// atomic, as several databases may be loaded at once
+static void count(int area, size_t old_size, size_t new_size) {
+	cx9r_mem_counter *c = &stats.areas[area];
+
+	atomic_max(&c->peak, __atomic_add_fetch(&c->current,
+			new_size - old_size, __ATOMIC_RELAXED));
+}
+
+void *cx9r_mem_alloc(int area, size_t size) {
+	return cx9r_mem_realloc(area, NULL, size);
+}
+
+void *cx9r_mem_realloc(int area, void *p, size_t size) {
+	char *block = p != NULL ? (char*)p - HEADER_SIZE : NULL;
+	size_t old_size = block != NULL ? *(size_t*)block : 0;
+
+	if ((block = realloc(block, HEADER_SIZE + size)) == NULL) return NULL;
+	*(size_t*)block = size;
+	count(area, old_size, size);
+	if (p == NULL) __atomic_add_fetch(&stats.areas[area].n_allocs, 1,
+			__ATOMIC_RELAXED);
+	return block + HEADER_SIZE;
+}
+
+void cx9r_mem_free(int area, void *p) {
+	char *block;
+
+	if (p == NULL) return;
+	block = (char*)p - HEADER_SIZE;
+	count(area, *(size_t*)block, 0);
+	free(block);
+}
+
+void cx9r_mem_sample(int phase) {
+	struct rusage usage;
+	long old = __atomic_load_n(&stats.peak_rss_kb[phase], __ATOMIC_RELAXED);
+
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		// kilobytes on Linux; concurrent loads keep the highest sample
+		while (usage.ru_maxrss > old && !__atomic_compare_exchange_n(
+				&stats.peak_rss_kb[phase], &old, usage.ru_maxrss, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	}
+}
+
+cx9r_mem_stats const *cx9r_mem_get_stats(void) {
+	return &stats;
+}
@@ -0,0 +1,92 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_MEM_STATS_H
+#define CX9R_MEM_STATS_H
+
+#include <stdlib.h>
+
+// areas of the loader whose heap memory is accounted for
+enum cx9r_mem_area_enum {
+	CX9R_MEM_DECRYPT,	// AES buffers and hashed blocks
+	CX9R_MEM_GZIP,		// input buffer and inflate state
+	CX9R_MEM_XML,		// expat and character data
+	CX9R_N_MEM_AREAS
+};
+
+// points at which the peak resident set size is sampled
+enum cx9r_mem_phase_enum {
+	CX9R_MEM_PHASE_START,	// before reading the file
+	CX9R_MEM_PHASE_KEY,		// header read and master key derived
+	CX9R_MEM_PHASE_PARSE,	// payload decrypted, inflated and parsed
+	CX9R_N_MEM_PHASES
+};
+
+typedef struct {
+	size_t current;		// bytes allocated now
+	size_t peak;		// most bytes allocated at any time
+	size_t n_allocs;	// number of allocations
+} cx9r_mem_counter;
+
+typedef struct {
+	cx9r_mem_counter areas[CX9R_N_MEM_AREAS];
+	long peak_rss_kb[CX9R_N_MEM_PHASES];	// 0 if not sampled
+} cx9r_mem_stats;
+
+/**
+ * Allocate memory accounted to an area. The counters are updated
+ * atomically, as several databases may be loaded at once; they then sum
+ * up all of the loads.
+ * @param area area
+ * @param size number of bytes
+ * @return pointer to the memory, or NULL if allocation failed
+ */
+void *cx9r_mem_alloc(int area, size_t size);
+
+/**
+ * Resize memory from cx9r_mem_alloc().
+ * @param area area the memory was allocated for
+ * @param p memory, or NULL to allocate
+ * @param size new number of bytes
+ * @return pointer to the memory, or NULL if allocation failed
+ */
+void *cx9r_mem_realloc(int area, void *p, size_t size);
+
+/**
+ * Free memory from cx9r_mem_alloc().
+ * @param area area the memory was allocated for
+ * @param p memory, may be NULL
+ */
+void cx9r_mem_free(int area, void *p);
+
+/**
+ * Record the peak resident set size of the process so far. It is that
+ * of the whole process, so with loads running at once the highest sample
+ * of each phase is kept, which covers all of them.
+ * @param phase phase that just ended
+ */
+void cx9r_mem_sample(int phase);
+
+/**
+ * Get the counters, which run from the start of the process.
+ * @return statistics
+ */
+cx9r_mem_stats const *cx9r_mem_get_stats(void);
+
+#endif
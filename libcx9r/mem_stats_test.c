@@ -0,0 +1,68 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mem_stats.h"
+#include <stdio.h>
+#include <string.h>
+
+int main() {
+
+	cx9r_mem_stats const *stats = cx9r_mem_get_stats();
+	cx9r_mem_counter const *c = &stats->areas[CX9R_MEM_XML];
+	char *p;
+	char *q;
+
+	printf("counting allocations...");
+	if ((p = cx9r_mem_alloc(CX9R_MEM_XML, 100)) == NULL) goto fail;
+	if ((q = cx9r_mem_alloc(CX9R_MEM_XML, 50)) == NULL) goto fail;
+	memset(p, 1, 100);
+	if (c->current != 150 || c->peak != 150 || c->n_allocs != 2) goto fail;
+	printf("ok\n");
+
+	printf("resizing...");
+	if ((p = cx9r_mem_realloc(CX9R_MEM_XML, p, 1000)) == NULL) goto fail;
+	// the contents move along
+	if (p[99] != 1) goto fail;
+	if ((p = cx9r_mem_realloc(CX9R_MEM_XML, p, 10)) == NULL) goto fail;
+	if (c->current != 60 || c->peak != 1050 || c->n_allocs != 2) goto fail;
+	printf("ok\n");
+
+	printf("freeing...");
+	cx9r_mem_free(CX9R_MEM_XML, p);
+	cx9r_mem_free(CX9R_MEM_XML, q);
+	cx9r_mem_free(CX9R_MEM_XML, NULL);
+	if (c->current != 0 || c->peak != 1050) goto fail;
+	// other areas are not affected
+	if (stats->areas[CX9R_MEM_GZIP].peak != 0) goto fail;
+	printf("ok\n");
+
+	printf("sampling...");
+	cx9r_mem_sample(CX9R_MEM_PHASE_KEY);
+	if (stats->peak_rss_kb[CX9R_MEM_PHASE_KEY] <= 0) goto fail;
+	printf("ok\n");
+
+	printf("All memory statistics tests passed\n");
+
+	return 0;
+
+	fail:
+
+	printf("fail\n");
+	return 1;
+}
@@ -0,0 +1,547 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Queries are parsed by recursive descent into a tree of operators and
+// terms. AND and OR nodes are flattened and their operands ordered by
+// an estimate of their cost, so that the evaluation, which stops at the
+// first operand that decides the result, tries cheap tests first:
+// constants, then group names (evaluated once per group and inherited
+// by the groups below), then single fields, and scans over all fields
+// last.
+#include "query.h"
+#include <string.h>
+#include <strings.h>
+
+enum query_node_type {
+	NODE_FALSE,
+	NODE_AND,
+	NODE_OR,
+	NODE_NOT,
+	NODE_GROUP,		// name of the group or an enclosing group
+	NODE_FIELD,		// value of one field, by id
+	NODE_ANY		// title, any field value or any group name
+};
+
+typedef struct query_node query_node;
+
+struct query_node {
+	int type;
+	int cost;
+	// operands of AND, OR and NOT
+	query_node **children;
+	size_t n_children;
+	// terms
+	int field_id;
+	char *glob;			// pattern if it has wildcards, else NULL
+	cx9r_substr substr;	// pattern if it has no wildcards
+	// whether the pattern matches a group or a group above it, for the
+	// group last evaluated at each depth
+	cx9r_kt_group const **memo_group;
+	char *memo_match;
+	size_t memo_capacity;
+};
+
+struct cx9r_query {
+	query_node *root;
+	int flags;
+};
+
+enum query_token {
+	TOKEN_END,
+	TOKEN_OPEN,
+	TOKEN_CLOSE,
+	TOKEN_AND,
+	TOKEN_OR,
+	TOKEN_NOT,
+	TOKEN_TERM
+};
+
+typedef struct {
+	cx9r_key_tree *kt;
+	char const *p;		// rest of the query text
+	int flags;
+	int token;			// current token
+	char *field;		// field of a term token, NULL if none
+	char *pattern;		// pattern of a term token
+	char *buffer;		// holds field and pattern, as long as the query
+	char const *error;
+} parser;
+
+// costs of the terms
+#define COST_FALSE 0
+#define COST_GROUP 1
+#define COST_STD_FIELD 2
+#define COST_CUSTOM_FIELD 4
+#define COST_ANY 16
+#define COST_MAX 1000000
+
+static char const *const std_field_keywords[CX9R_N_STD_FIELDS] = {
+	"title", "username", "password", "url", "notes"
+};
+
+static uint8_t fold(uint8_t c) {
+	return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+static int is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// read the next token
+static void next_token(parser *ps) {
+	char *out = ps->buffer;
+	char const *start;
+	int quoted = 0;
+	int was_quoted = 0;
+
+	while (is_space(*ps->p)) ps->p++;
+	ps->field = NULL;
+	ps->pattern = NULL;
+
+	if (*ps->p == 0) {
+		ps->token = TOKEN_END;
+		return;
+	}
+	if (*ps->p == '(' || *ps->p == ')') {
+		ps->token = *ps->p++ == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+		return;
+	}
+
+	start = ps->p;
+	for (; *ps->p != 0; ps->p++) {
+		if (*ps->p == '"') {
+			quoted = !quoted;
+			was_quoted = 1;
+		}
+		else if (!quoted && (is_space(*ps->p) || *ps->p == '(' || *ps->p == ')')) {
+			break;
+		}
+		else if (!quoted && *ps->p == ':' && ps->field == NULL) {
+			// the first unquoted colon ends the field name
+			*out++ = 0;
+			ps->field = ps->buffer;
+		}
+		else {
+			*out++ = *ps->p;
+		}
+	}
+	*out = 0;
+	if (quoted) {
+		ps->error = "unterminated quote";
+		ps->token = TOKEN_END;
+		return;
+	}
+	ps->pattern = ps->field != NULL ? ps->field + strlen(ps->field) + 1 : ps->buffer;
+	ps->token = TOKEN_TERM;
+	if (!was_quoted) {
+		if (ps->p - start == 3 && strncmp(start, "AND", 3) == 0) ps->token = TOKEN_AND;
+		else if (ps->p - start == 2 && strncmp(start, "OR", 2) == 0) ps->token = TOKEN_OR;
+		else if (ps->p - start == 3 && strncmp(start, "NOT", 3) == 0) ps->token = TOKEN_NOT;
+	}
+}
+
+static void node_free(query_node *n) {
+	size_t i;
+
+	if (n == NULL) return;
+	for (i = 0; i < n->n_children; i++) {
+		node_free(n->children[i]);
+	}
+	free(n->children);
+	free(n->memo_group);
+	free(n->memo_match);
+	free(n->glob);
+	cx9r_substr_free(&n->substr);
+	free(n);
+}
+
+static query_node *node_create(int type, int cost) {
+	query_node *n;
+
+	if ((n = calloc(1, sizeof(query_node))) == NULL) {
+		return NULL;
+	}
+	n->type = type;
+	n->cost = cost;
+	n->field_id = CX9R_FIELD_NONE;
+	return n;
+}
+
+// add an operand to an AND or OR node; operands of the same kind are
+// merged into the node
+static int node_add(query_node *n, query_node *child) {
+	query_node **children;
+	size_t i;
+
+	if (child->type == n->type) {
+		for (i = 0; i < child->n_children; i++) {
+			if (!node_add(n, child->children[i])) return 0;
+			child->children[i] = NULL;
+		}
+		child->n_children = 0;
+		node_free(child);
+		return 1;
+	}
+	children = realloc(n->children, (n->n_children + 1) * sizeof(query_node*));
+	if (children == NULL) {
+		node_free(child);
+		return 0;
+	}
+	n->children = children;
+	n->children[n->n_children++] = child;
+	n->cost = n->cost + child->cost < COST_MAX ? n->cost + child->cost : COST_MAX;
+	return 1;
+}
+
+// order the operands by cost; stable, so that equal operands keep the
+// order they were written in
+static void node_sort(query_node *n) {
+	query_node *child;
+	size_t i;
+	size_t j;
+
+	for (i = 1; i < n->n_children; i++) {
+		child = n->children[i];
+		for (j = i; j > 0 && n->children[j - 1]->cost > child->cost; j--) {
+			n->children[j] = n->children[j - 1];
+		}
+		n->children[j] = child;
+	}
+}
+
+static query_node *parse_or(parser *ps);
+
+static query_node *parse_term(parser *ps) {
+	query_node *n;
+	char const *field = ps->field;
+	int i;
+
+	if (field == NULL) {
+		n = node_create(NODE_ANY, COST_ANY);
+	}
+	else if (strcasecmp(field, "group") == 0) {
+		n = node_create(NODE_GROUP, COST_GROUP);
+	}
+	else {
+		n = node_create(NODE_FIELD, COST_CUSTOM_FIELD);
+		if (n == NULL) return NULL;
+		for (i = 0; i < CX9R_N_STD_FIELDS; i++) {
+			if (strcasecmp(field, std_field_keywords[i]) == 0) {
+				n->field_id = i;
+				n->cost = COST_STD_FIELD;
+			}
+		}
+		if (n->field_id == CX9R_FIELD_NONE) {
+			n->field_id = cx9r_key_tree_lookup_field_id(ps->kt, field);
+			if (n->field_id == CX9R_FIELD_NONE) {
+				// no entry has such a field
+				n->type = NODE_FALSE;
+				n->cost = COST_FALSE;
+			}
+		}
+	}
+	if (n == NULL) return NULL;
+
+	if (strpbrk(ps->pattern, "*?") != NULL) {
+		if ((n->glob = strdup(ps->pattern)) == NULL) goto fail;
+		n->cost++;
+	}
+	else if (!cx9r_substr_compile(&n->substr, ps->pattern, ps->flags)) {
+		goto fail;
+	}
+	next_token(ps);
+	return n;
+
+fail:
+
+	node_free(n);
+	return NULL;
+}
+
+static query_node *parse_unary(parser *ps) {
+	query_node *n;
+	query_node *child;
+
+	switch (ps->token) {
+	case TOKEN_NOT:
+		next_token(ps);
+		if ((child = parse_unary(ps)) == NULL) return NULL;
+		if ((n = node_create(NODE_NOT, 0)) == NULL) {
+			node_free(child);
+			return NULL;
+		}
+		if ((n->children = malloc(sizeof(query_node*))) == NULL) {
+			node_free(child);
+			node_free(n);
+			return NULL;
+		}
+		n->children[0] = child;
+		n->n_children = 1;
+		n->cost = child->cost;
+		return n;
+	case TOKEN_OPEN:
+		next_token(ps);
+		if ((n = parse_or(ps)) == NULL) return NULL;
+		if (ps->token != TOKEN_CLOSE) {
+			if (ps->error == NULL) ps->error = "missing )";
+			node_free(n);
+			return NULL;
+		}
+		next_token(ps);
+		return n;
+	case TOKEN_TERM:
+		return parse_term(ps);
+	default:
+		if (ps->error == NULL) ps->error = "missing term";
+		return NULL;
+	}
+}
+
+// a sequence of operands joined by AND, NOT or nothing
+static query_node *parse_and(parser *ps) {
+	query_node *n;
+	query_node *child;
+
+	if ((child = parse_unary(ps)) == NULL) return NULL;
+	if (ps->token != TOKEN_AND && ps->token != TOKEN_NOT
+			&& ps->token != TOKEN_OPEN && ps->token != TOKEN_TERM) {
+		return child;
+	}
+	if ((n = node_create(NODE_AND, 0)) == NULL) {
+		node_free(child);
+		return NULL;
+	}
+	if (!node_add(n, child)) goto fail;
+	while (ps->token == TOKEN_AND || ps->token == TOKEN_NOT
+			|| ps->token == TOKEN_OPEN || ps->token == TOKEN_TERM) {
+		// "a NOT b" is "a AND NOT b"
+		if (ps->token == TOKEN_AND) next_token(ps);
+		if ((child = parse_unary(ps)) == NULL) goto fail;
+		if (!node_add(n, child)) goto fail;
+	}
+	node_sort(n);
+	return n;
+
+fail:
+
+	node_free(n);
+	return NULL;
+}
+
+static query_node *parse_or(parser *ps) {
+	query_node *n;
+	query_node *child;
+
+	if ((child = parse_and(ps)) == NULL) return NULL;
+	if (ps->token != TOKEN_OR) return child;
+	if ((n = node_create(NODE_OR, 0)) == NULL) {
+		node_free(child);
+		return NULL;
+	}
+	if (!node_add(n, child)) goto fail;
+	while (ps->token == TOKEN_OR) {
+		next_token(ps);
+		if ((child = parse_and(ps)) == NULL) goto fail;
+		if (!node_add(n, child)) goto fail;
+	}
+	node_sort(n);
+	return n;
+
+fail:
+
+	node_free(n);
+	return NULL;
+}
+
+cx9r_query *cx9r_query_compile(cx9r_key_tree *kt, char const *text, int flags,
+		char const **error) {
+	cx9r_query *q;
+	parser ps;
+
+	*error = NULL;
+	if ((q = malloc(sizeof(cx9r_query))) == NULL) {
+		return NULL;
+	}
+	q->flags = flags;
+	q->root = NULL;
+
+	ps.kt = kt;
+	ps.p = text;
+	ps.flags = flags;
+	ps.error = NULL;
+	if ((ps.buffer = malloc(strlen(text) + 2)) == NULL) {
+		free(q);
+		return NULL;
+	}
+	next_token(&ps);
+	if (ps.token == TOKEN_END && ps.error == NULL) {
+		ps.error = "empty query";
+	}
+	else if ((q->root = parse_or(&ps)) != NULL && ps.token != TOKEN_END) {
+		if (ps.error == NULL) {
+			ps.error = ps.token == TOKEN_CLOSE ? "unbalanced )" : "missing term";
+		}
+	}
+	free(ps.buffer);
+
+	if (ps.error != NULL || q->root == NULL) {
+		*error = ps.error;
+		cx9r_query_free(q);
+		return NULL;
+	}
+	return q;
+}
+
+void cx9r_query_free(cx9r_query *q) {
+	if (q == NULL) return;
+	node_free(q->root);
+	free(q);
+}
+
+// match a whole string against a glob with * and ?
+static int glob_match(char const *glob, char const *s, int ignore_case) {
+	char const *star = NULL;	// position after the last * in glob
+	char const *resume = NULL;	// where to retry in s for that *
+
+	while (*s != 0) {
+		if (*glob == '*') {
+			star = ++glob;
+			resume = s;
+		}
+		else if (*glob != 0 && (*glob == '?' || *glob == *s
+				|| (ignore_case && fold(*glob) == fold(*s)))) {
+			glob++;
+			s++;
+		}
+		else if (star != NULL) {
+			// let the last * absorb one more character
+			glob = star;
+			s = ++resume;
+		}
+		else {
+			return 0;
+		}
+	}
+	while (*glob == '*') glob++;
+	return *glob == 0;
+}
+
+static int term_match(query_node const *n, char const *value, int flags) {
+	if (value == NULL) return 0;
+	if (n->glob != NULL) {
+		return glob_match(n->glob, value, flags & CX9R_SUBSTR_IGNORE_CASE);
+	}
+	return cx9r_substr_contains(&n->substr, value);
+}
+
+// Check whether the pattern of a term matches the name of a group or of
+// any group above it. Results are remembered per depth, so when groups
+// are visited in tree order each name is tested once and a group
+// inherits the result of its parent.
+static int ancestor_match(query_node *n, int flags, cx9r_kt_group const *g) {
+	cx9r_kt_group const **memo_group;
+	cx9r_kt_group const *a;
+	char *memo_match;
+	size_t capacity;
+	size_t depth = g->depth;
+	size_t top;
+
+	if (depth >= n->memo_capacity) {
+		capacity = 2 * (depth + 1);
+		memo_group = realloc(n->memo_group, capacity * sizeof(cx9r_kt_group*));
+		if (memo_group != NULL) n->memo_group = memo_group;
+		memo_match = realloc(n->memo_match, capacity);
+		if (memo_match != NULL) n->memo_match = memo_match;
+		if (memo_group == NULL || memo_match == NULL) {
+			// without memory, test the names one by one
+			for (a = g; a != NULL; a = a->parent) {
+				if (term_match(n, a->name, flags)) return 1;
+			}
+			return 0;
+		}
+		memset(n->memo_group + n->memo_capacity, 0,
+				(capacity - n->memo_capacity) * sizeof(cx9r_kt_group*));
+		n->memo_capacity = capacity;
+	}
+	if (n->memo_group[depth] == g) {
+		return n->memo_match[depth];
+	}
+
+	// test the names up to the first group with a known result ...
+	for (a = g; a != NULL && n->memo_group[a->depth] != a; a = a->parent) {
+		n->memo_group[a->depth] = a;
+		n->memo_match[a->depth] = term_match(n, a->name, flags);
+	}
+	// ... and pass the results down
+	for (top = a != NULL ? a->depth + 1 : 1; top <= depth; top++) {
+		n->memo_match[top] |= n->memo_match[top - 1];
+	}
+	return n->memo_match[depth];
+}
+
+static int node_match(query_node *n, int flags, cx9r_kt_group const *g,
+		cx9r_kt_entry const *e) {
+	cx9r_kt_field const *f;
+	size_t i;
+
+	switch (n->type) {
+	case NODE_AND:
+		for (i = 0; i < n->n_children; i++) {
+			if (!node_match(n->children[i], flags, g, e)) return 0;
+		}
+		return 1;
+	case NODE_OR:
+		for (i = 0; i < n->n_children; i++) {
+			if (node_match(n->children[i], flags, g, e)) return 1;
+		}
+		return 0;
+	case NODE_NOT:
+		return !node_match(n->children[0], flags, g, e);
+	case NODE_GROUP:
+		return ancestor_match(n, flags, g);
+	case NODE_FIELD:
+		if (n->field_id == CX9R_FIELD_TITLE) {
+			return term_match(n, e->name, flags);
+		}
+		if (n->field_id < CX9R_N_STD_FIELDS) {
+			f = e->std_fields[n->field_id];
+		}
+		else {
+			f = e->fields;
+		}
+		// a name may occur more than once in an entry
+		for (; f != NULL; f = f->next) {
+			if (f->id == n->field_id && term_match(n, f->value, flags)) return 1;
+		}
+		return 0;
+	case NODE_ANY:
+		if (term_match(n, e->name, flags)) return 1;
+		for (f = e->fields; f != NULL; f = f->next) {
+			if (term_match(n, f->value, flags)) return 1;
+		}
+		return ancestor_match(n, flags, g);
+	default:
+		return 0;
+	}
+}
+
+int cx9r_query_match(cx9r_query *q, cx9r_kt_group const *g,
+		cx9r_kt_entry const *e) {
+	return node_match(q->root, q->flags, g, e);
+}
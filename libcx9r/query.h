@@ -0,0 +1,66 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_QUERY_H
+#define CX9R_QUERY_H
+
+#include "key_tree.h"
+#include "substr.h"
+
+typedef struct cx9r_query cx9r_query;
+
+/**
+ * Compile a query for a key tree. A query is made of terms combined
+ * with AND (also implied between adjacent terms), OR, NOT and
+ * parentheses. A term is a pattern, optionally preceded by a field:
+ *   title:P, username:P, password:P, url:P, notes:P  standard fields
+ *   group:P  name of the entry's group or any enclosing group
+ *   NAME:P   custom field NAME (exact name)
+ * Standard field names and "group" may be written in any case.
+ *   P        title, any field or any enclosing group name
+ * A pattern with * or ? must match the whole value (glob), otherwise it
+ * must occur in it. Patterns and field names may be quoted with "".
+ * @param kt key tree the query is applied to
+ * @param text query
+ * @param flags CX9R_SUBSTR_IGNORE_CASE or 0
+ * @param error receives a description of a syntax error
+ * @return query, or NULL on a syntax error or if allocation failed
+ * (then *error is NULL)
+ */
+cx9r_query *cx9r_query_compile(cx9r_key_tree *kt, char const *text, int flags,
+		char const **error);
+
+/**
+ * Test an entry against a query. Results for groups are reused, which
+ * pays off when entries are tested in tree order.
+ * @param q query
+ * @param g group of the entry
+ * @param e entry
+ * @return 1 if the entry matches, 0 if not
+ */
+int cx9r_query_match(cx9r_query *q, cx9r_kt_group const *g,
+		cx9r_kt_entry const *e);
+
+/**
+ * Free a query.
+ * @param q query
+ */
+void cx9r_query_free(cx9r_query *q);
+
+#endif
@@ -0,0 +1,183 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "query.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+	char const *query;
+	int flags;
+	char const *titles;	// titles of the matching entries, in tree order
+} query_case;
+
+static query_case const cases[] = {
+	{"web", 0, "web01,web02"},
+	{"title:web01", 0, "web01"},
+	{"group:Prod", 0, "web01,web02,deep"},
+	{"group:prod", 0, ""},
+	{"group:prod", CX9R_SUBSTR_IGNORE_CASE, "web01,web02,deep"},
+	{"GROUP:Sub", 0, "deep"},
+	{"group:Root", 0, "web01,web02,deep,db01,old"},
+	{"group:Sub OR group:Dev", 0, "deep,db01,old"},
+	{"url:*.corp", 0, "web01,db01"},
+	{"url:*.CORP", CX9R_SUBSTR_IGNORE_CASE, "web01,db01"},
+	{"url:https://*", 0, "web01,web02"},
+	{"url:?ttp:*", 0, "db01"},
+	{"group:Prod AND url:*.corp", 0, "web01"},
+	{"group:Prod url:*.corp", 0, "web01"},
+	{"group:Prod NOT title:web01", 0, "web02,deep"},
+	{"NOT group:Prod", 0, "db01,old"},
+	{"title:web01 OR title:db01", 0, "web01,db01"},
+	{"(title:web01 OR title:old) NOT url:*.corp", 0, "old"},
+	{"title:old OR group:Sub AND password:p", 0, "deep,old"},
+	{"Custom:42", 0, "db01"},
+	{"custom:42", 0, ""},
+	{"nosuchfield:x", 0, ""},
+	{"\"Root\"", 0, "web01,web02,deep,db01,old"},
+	{"title:\"web 02\"", 0, ""},
+	{"notes:\"two words\"", 0, "web02"},
+	{"NOT NOT title:old", 0, "old"},
+	{"\"OR\"", 0, ""},
+};
+
+static char const *const syntax_errors[] = {
+	"",
+	"title:a AND",
+	"(title:a",
+	"title:a)",
+	"title:\"a",
+	"NOT",
+	"a OR OR b",
+	"OR",
+};
+
+static cx9r_kt_entry *add_entry(cx9r_kt_group *g, char const *title,
+		char const *url, char const *password) {
+	cx9r_kt_entry *e;
+	cx9r_kt_field *f;
+
+	if ((e = cx9r_kt_group_add_entry(g)) == NULL) return NULL;
+	if (cx9r_kt_entry_set_zname(e, title) == NULL) return NULL;
+	if ((f = cx9r_kt_entry_add_field(e)) == NULL) return NULL;
+	if (cx9r_kt_field_set_zname(f, "URL") == NULL) return NULL;
+	if (cx9r_kt_field_set_zvalue(f, url) == NULL) return NULL;
+	if ((f = cx9r_kt_entry_add_field(e)) == NULL) return NULL;
+	if (cx9r_kt_field_set_zname(f, "Password") == NULL) return NULL;
+	if (cx9r_kt_field_set_zvalue(f, password) == NULL) return NULL;
+	return e;
+}
+
+static int add_field(cx9r_kt_entry *e, char const *name, char const *value) {
+	cx9r_kt_field *f;
+
+	if ((f = cx9r_kt_entry_add_field(e)) == NULL) return 0;
+	if (cx9r_kt_field_set_zname(f, name) == NULL) return 0;
+	return cx9r_kt_field_set_zvalue(f, value) != NULL;
+}
+
+// run a query and list the titles of the matching entries
+static int run(cx9r_key_tree *kt, query_case const *c, char *titles) {
+	cx9r_query *q;
+	cx9r_kt_iter it;
+	char const *error;
+
+	*titles = 0;
+	if ((q = cx9r_query_compile(kt, c->query, c->flags, &error)) == NULL) {
+		return 0;
+	}
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_ENTRIES);
+	while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) {
+		if (it.event != CX9R_KT_ITER_ENTRY) continue;
+		if (cx9r_query_match(q, it.group, it.entry)) {
+			if (*titles != 0) strcat(titles, ",");
+			strcat(titles, cx9r_kt_entry_get_name(it.entry));
+		}
+	}
+	cx9r_query_free(q);
+	return 1;
+}
+
+int main() {
+
+	cx9r_key_tree *kt;
+	cx9r_kt_group *root;
+	cx9r_kt_group *prod;
+	cx9r_kt_group *g;
+	cx9r_kt_entry *e;
+	cx9r_query *q;
+	char const *error;
+	char titles[256];
+	size_t i;
+
+	printf("building key tree...");
+	if ((kt = cx9r_key_tree_create()) == NULL) goto bail;
+	root = cx9r_key_tree_get_root(kt);
+	if (cx9r_kt_group_set_zname(root, "Root") == NULL) goto dealloc_tree;
+	if ((prod = cx9r_kt_group_add_child(root)) == NULL) goto dealloc_tree;
+	if (cx9r_kt_group_set_zname(prod, "Prod") == NULL) goto dealloc_tree;
+	if ((e = add_entry(prod, "web01", "https://web01.corp", "s3cret")) == NULL)
+		goto dealloc_tree;
+	if ((e = add_entry(prod, "web02", "https://web02.example", "x")) == NULL)
+		goto dealloc_tree;
+	if (!add_field(e, "Notes", "two words")) goto dealloc_tree;
+	if ((g = cx9r_kt_group_add_child(prod)) == NULL) goto dealloc_tree;
+	if (cx9r_kt_group_set_zname(g, "Sub") == NULL) goto dealloc_tree;
+	if (add_entry(g, "deep", "", "p") == NULL) goto dealloc_tree;
+	if ((g = cx9r_kt_group_add_child(root)) == NULL) goto dealloc_tree;
+	if (cx9r_kt_group_set_zname(g, "Dev") == NULL) goto dealloc_tree;
+	if ((e = add_entry(g, "db01", "http://db01.corp", "y")) == NULL)
+		goto dealloc_tree;
+	if (!add_field(e, "Custom", "4242")) goto dealloc_tree;
+	if (add_entry(g, "old", "ftp://old", "pp") == NULL) goto dealloc_tree;
+	printf("ok\n");
+
+	printf("evaluating queries...");
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		if (!run(kt, &cases[i], titles) || strcmp(titles, cases[i].titles) != 0) {
+			printf("%s: got \"%s\"...", cases[i].query, titles);
+			goto dealloc_tree;
+		}
+	}
+	printf("ok\n");
+
+	printf("rejecting syntax errors...");
+	for (i = 0; i < sizeof(syntax_errors) / sizeof(syntax_errors[0]); i++) {
+		q = cx9r_query_compile(kt, syntax_errors[i], 0, &error);
+		if (q != NULL || error == NULL) {
+			cx9r_query_free(q);
+			printf("%s...", syntax_errors[i]);
+			goto dealloc_tree;
+		}
+	}
+	printf("ok\n");
+
+	cx9r_key_tree_free(kt);
+
+	return 0;
+
+dealloc_tree:
+
+	cx9r_key_tree_free(kt);
+
+bail:
+
+	printf("fail\n");
+	return 1;
+}
@@ -0,0 +1,183 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "regex_search.h"
+#include <string.h>
+
+// Skip the bracket expression starting at p; ] right after [ or [^ is
+// literal. Returns the character after the closing ].
+static char const *skip_bracket(char const *p) {
+	char c;
+
+	p++;
+	if (*p == '^') p++;
+	if (*p == ']') p++;
+	while (*p != 0 && *p != ']') {
+		// classes like [:digit:] hold a ] of their own
+		if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+			c = p[1];
+			for (p += 2; *p != 0 && !(*p == c && p[1] == ']'); p++);
+			if (*p != 0) p++;
+		}
+		if (*p != 0) p++;
+	}
+	if (*p != 0) p++;
+	return p;
+}
+
+// Extract the longest run of literal characters that every match must
+// contain. The scan is conservative: alternation anywhere gives up, and
+// groups, bracket expressions and optional characters end a run.
+static char *required_literal(char const *p) {
+	size_t length = strlen(p);
+	char *run;
+	char *best;
+	size_t n_run = 0;
+	size_t n_best = 0;
+	int depth;
+
+	if (strchr(p, '|') != NULL) return NULL;
+	if ((run = malloc(length + 1)) == NULL) return NULL;
+	if ((best = malloc(length + 1)) == NULL) {
+		free(run);
+		return NULL;
+	}
+
+	while (*p != 0) {
+		switch (*p) {
+		case '*':
+		case '?':
+		case '{':
+			// the previous character may be absent, all bytes of it
+			while (n_run > 0 && ((unsigned char)run[n_run - 1] & 0xC0) == 0x80)
+				n_run--;
+			if (n_run > 0) n_run--;
+			goto end_run;
+		case '+':
+			p++;
+			goto end_run;
+		case '[':
+			p = skip_bracket(p);
+			goto end_run;
+		case '(':
+			// skip the group, whose contents may be optional
+			for (depth = 0; *p != 0; p++) {
+				if (*p == '\\' && p[1] != 0) p++;
+				else if (*p == '[') {
+					// a ) inside a bracket expression ends nothing
+					p = skip_bracket(p) - 1;
+				}
+				else if (*p == '(') depth++;
+				else if (*p == ')' && --depth == 0) break;
+			}
+			if (*p != 0) p++;
+			goto end_run;
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+			p++;
+			goto end_run;
+		case '\\':
+			if (p[1] == 0 || (p[1] >= '0' && p[1] <= '9') || (p[1] >= 'a'
+					&& p[1] <= 'z') || (p[1] >= 'A' && p[1] <= 'Z')) {
+				// back references and GNU classes like \w
+				p += p[1] != 0 ? 2 : 1;
+				goto end_run;
+			}
+			p++;
+			// fall through
+		default:
+			// a quantifier after this character is handled by the next step
+			run[n_run++] = *p++;
+			continue;
+		}
+	end_run:
+		if (n_run > n_best) {
+			memcpy(best, run, n_run);
+			n_best = n_run;
+		}
+		n_run = 0;
+		// a quantifier after a group or bracket expression ends nothing more
+		while (*p == '*' || *p == '?' || *p == '+') p++;
+		if (*p == '{') {
+			while (*p != 0 && *p != '}') p++;
+			if (*p != 0) p++;
+		}
+	}
+	if (n_run > n_best) {
+		memcpy(best, run, n_run);
+		n_best = n_run;
+	}
+	free(run);
+	if (n_best == 0) {
+		free(best);
+		return NULL;
+	}
+	best[n_best] = 0;
+	return best;
+}
+
+int cx9r_regex_compile(cx9r_regex *r, char const *pattern, int flags,
+		char *error, size_t error_size) {
+	int err;
+
+	err = regcomp(&r->regex, pattern, REG_EXTENDED | REG_NOSUB
+			| (flags & CX9R_SUBSTR_IGNORE_CASE ? REG_ICASE : 0));
+	if (err != 0) {
+		regerror(err, &r->regex, error, error_size);
+		return 0;
+	}
+	r->literal = required_literal(pattern);
+	if (r->literal != NULL && flags & CX9R_SUBSTR_IGNORE_CASE) {
+		// the prefilter folds only ASCII, the regex engine may fold more
+		for (err = 0; r->literal[err] != 0; err++) {
+			if ((unsigned char)r->literal[err] >= 0x80) {
+				free(r->literal);
+				r->literal = NULL;
+				break;
+			}
+		}
+	}
+	if (r->literal != NULL && !cx9r_substr_compile(&r->prefilter, r->literal,
+			flags & CX9R_SUBSTR_IGNORE_CASE)) {
+		free(r->literal);
+		r->literal = NULL;
+	}
+	return 1;
+}
+
+void cx9r_regex_free(cx9r_regex *r) {
+	regfree(&r->regex);
+	if (r->literal != NULL) {
+		cx9r_substr_free(&r->prefilter);
+		free(r->literal);
+		r->literal = NULL;
+	}
+}
+
+int cx9r_regex_match(cx9r_regex const *r, char const *s) {
+	if (s == NULL) return 0;
+	if (r->literal != NULL && !cx9r_substr_contains(&r->prefilter, s)) return 0;
+	return regexec(&r->regex, s, 0, NULL, 0) == 0;
+}
+
+char const *cx9r_regex_get_literal(cx9r_regex const *r) {
+	return r->literal;
+}
@@ -0,0 +1,68 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_REGEX_SEARCH_H
+#define CX9R_REGEX_SEARCH_H
+
+#include <regex.h>
+#include "substr.h"
+
+/// POSIX extended regular expression with a literal prefilter: a string
+/// that must occur in every match is searched for first, and only
+/// strings that contain it are given to the regex engine.
+typedef struct {
+	regex_t regex;
+	char *literal;		// required literal, NULL if none was found
+	cx9r_substr prefilter;
+} cx9r_regex;
+
+/**
+ * Compile a regular expression.
+ * @param r regular expression
+ * @param pattern POSIX extended regular expression
+ * @param flags CX9R_SUBSTR_IGNORE_CASE or 0
+ * @param error buffer for a description of a syntax error
+ * @param error_size size of the error buffer
+ * @return 1 on success, 0 on error
+ */
+int cx9r_regex_compile(cx9r_regex *r, char const *pattern, int flags,
+		char *error, size_t error_size);
+
+/**
+ * Free a compiled regular expression.
+ * @param r regular expression
+ */
+void cx9r_regex_free(cx9r_regex *r);
+
+/**
+ * Check whether a string contains a match.
+ * @param r regular expression
+ * @param s zero terminated string, may be NULL
+ * @return 1 if there is a match, 0 if not
+ */
+int cx9r_regex_match(cx9r_regex const *r, char const *s);
+
+/**
+ * Get the literal used to prefilter strings.
+ * @param r regular expression
+ * @return literal, or NULL if every string is given to the regex engine
+ */
+char const *cx9r_regex_get_literal(cx9r_regex const *r);
+
+#endif
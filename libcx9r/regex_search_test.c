@@ -0,0 +1,131 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "regex_search.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+	char const *pattern;
+	char const *literal;	// expected prefilter literal, NULL for none
+} literal_case;
+
+static literal_case const literals[] = {
+	{"host[0-9]+\\.corp", ".corp"},
+	{"^web0[12]$", "web0"},
+	{"abcd*e", "abc"},
+	{"ab+c", "ab"},
+	{"x(abc)?yz", "yz"},
+	{"(abcdef)yz", "yz"},
+	{"a|bcdef", NULL},
+	{"a.b", "a"},
+	{"\\.example\\.org", ".example.org"},
+	{"\\w+foo", "foo"},
+	{"[]abc]def", "def"},
+	{"[[:alpha:]]x", "x"},
+	{"[[:digit:]]+-[[:digit:]]+", "-"},
+	{"[[.-.][=a=]]bc", "bc"},
+	{"x\xc3\xa9*", "x"},
+	{"x\xc3\xa9+", "x\xc3\xa9"},
+	{"ab{2,3}cd", "cd"},
+	{"([)])", NULL},
+	{"([)]x)yz", "yz"},
+	{".*", NULL},
+};
+
+typedef struct {
+	char const *pattern;
+	int flags;
+	char const *s;
+	int match;
+} match_case;
+
+static match_case const matches[] = {
+	{"host[0-9]+\\.corp", 0, "ssh://host0042.corp:22", 1},
+	{"host[0-9]+\\.corp", 0, "ssh://host.corp", 0},
+	{"host[0-9]+\\.corp", 0, "ssh://hostx42.corp", 0},
+	{"^web0[12]$", 0, "web02", 1},
+	{"^web0[12]$", 0, "web03", 0},
+	{"[[:alpha:]]x", 0, "ax", 1},
+	{"[[:digit:]]+-[[:digit:]]+", 0, "db12-34", 1},
+	{"[[:digit:]]+-[[:digit:]]+", 0, "db12-x", 0},
+	{"([)])", 0, ")", 1},
+	{"([)]x)yz", 0, ")xyz", 1},
+	{"x(abc)?yz", 0, "xyz", 1},
+	{"a|bcdef", 0, "xxa", 1},
+	{"WEB0[12]", CX9R_SUBSTR_IGNORE_CASE, "web01", 1},
+	{"WEB0[12]", 0, "web01", 0},
+};
+
+int main() {
+
+	cx9r_regex r;
+	char error[128];
+	char const *literal;
+	size_t i;
+
+	printf("extracting literals...");
+	for (i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+		if (!cx9r_regex_compile(&r, literals[i].pattern, 0, error, sizeof(error)))
+			goto fail;
+		literal = cx9r_regex_get_literal(&r);
+		if (literal == NULL ? literals[i].literal != NULL
+				: literals[i].literal == NULL || strcmp(literal, literals[i].literal) != 0) {
+			printf("%s: %s...", literals[i].pattern, literal);
+			cx9r_regex_free(&r);
+			goto fail;
+		}
+		cx9r_regex_free(&r);
+	}
+	printf("ok\n");
+
+	printf("matching...");
+	for (i = 0; i < sizeof(matches) / sizeof(matches[0]); i++) {
+		if (!cx9r_regex_compile(&r, matches[i].pattern, matches[i].flags, error,
+				sizeof(error))) goto fail;
+		if (cx9r_regex_match(&r, matches[i].s) != matches[i].match) {
+			printf("%s: %s...", matches[i].pattern, matches[i].s);
+			cx9r_regex_free(&r);
+			goto fail;
+		}
+		if (cx9r_regex_match(&r, NULL)) {
+			cx9r_regex_free(&r);
+			goto fail;
+		}
+		cx9r_regex_free(&r);
+	}
+	printf("ok\n");
+
+	printf("rejecting syntax errors...");
+	if (cx9r_regex_compile(&r, "a(b", 0, error, sizeof(error))) {
+		cx9r_regex_free(&r);
+		goto fail;
+	}
+	if (error[0] == 0) goto fail;
+	printf("ok\n");
+
+	printf("All regex search tests passed\n");
+
+	return 0;
+
+	fail:
+
+	printf("fail\n");
+	return 1;
+}
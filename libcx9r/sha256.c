@@ -58,3 +58,36 @@ cx9r_err cx9r_sha256_hash_buffer(uint8_t *hash, uint8_t *buffer, size_t length)
   gcry_md_hash_buffer(GCRY_MD_SHA256, hash, buffer, length);
   return CX9R_OK;
 }
+
+cx9r_err cx9r_sha512_hash_buffer(uint8_t *hash, uint8_t *buffer, size_t length)
+{
+  gcry_md_hash_buffer(GCRY_MD_SHA512, hash, buffer, length);
+  return CX9R_OK;
+}
+
+cx9r_err cx9r_hmac_sha256(uint8_t *hash, uint8_t *key, size_t key_length,
+		uint8_t *buffer, size_t length)
+{
+  gcry_md_hd_t ctx;
+  unsigned char *gcry_hash;
+  cx9r_err err = CX9R_OK;
+
+  CHECK((gcry_md_open(&ctx, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC)
+		  == GPG_ERR_NO_ERROR), err, CX9R_SHA256_FAILURE, cx9r_hmac_sha256_bail);
+  CHECK((gcry_md_setkey(ctx, key, key_length) == GPG_ERR_NO_ERROR), err,
+		  CX9R_SHA256_FAILURE, cx9r_hmac_sha256_cleanup);
+  gcry_md_write(ctx, buffer, length);
+
+  gcry_hash = gcry_md_read(ctx, GCRY_MD_SHA256);
+  CHECK((gcry_hash != NULL), err, CX9R_SHA256_FAILURE, cx9r_hmac_sha256_cleanup);
+
+  memcpy(hash, gcry_hash, CX9R_SHA256_HASH_LENGTH);
+
+cx9r_hmac_sha256_cleanup:
+
+  gcry_md_close(ctx);
+
+cx9r_hmac_sha256_bail:
+
+  return err;
+}
@@ -26,6 +26,7 @@
 #include "../config.h"
 
 #define CX9R_SHA256_HASH_LENGTH 32
+#define CX9R_SHA512_HASH_LENGTH 64
 
 #ifdef GCRYPT_WITH_SHA256
 #   include <gcrypt.h>
@@ -40,6 +41,9 @@ cx9r_err cx9r_sha256_init(cx9r_sha256_ctx *ctx);
 cx9r_err cx9r_sha256_process(cx9r_sha256_ctx *ctx, uint8_t *buffer, size_t length);
 cx9r_err cx9r_sha256_close(cx9r_sha256_ctx *ctx, uint8_t *hash);
 cx9r_err cx9r_sha256_hash_buffer(uint8_t *hash, uint8_t *buffer, size_t length);
+cx9r_err cx9r_sha512_hash_buffer(uint8_t *hash, uint8_t *buffer, size_t length);
+cx9r_err cx9r_hmac_sha256(uint8_t *hash, uint8_t *key, size_t key_length,
+		uint8_t *buffer, size_t length);
 
 #endif
 
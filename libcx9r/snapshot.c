@@ -0,0 +1,524 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Snapshots hold a parsed key tree in a compact, pointer-free form, so
+// that an unchanged database can be loaded without decrypting,
+// inflating and parsing it again. Layout, integers little endian:
+//
+//   magic, header hash, mtime, size, iv, payload length
+//   payload, encrypted with AES-256 in counter mode
+//   HMAC-SHA-256 of all of the above
+//
+// The payload is a string heap, followed by the number of names and of
+// each kind of node, the field names other than the standard ones in the
+// order of their ids, and the nodes in tree order. Strings
+// are referred to by 32-bit offsets into the heap, field names by their
+// ids. Loading copies the heap into the tree once, allocates the nodes
+// in one array per kind and links them up, without parsing any string.
+#include "snapshot.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAGIC_LENGTH 8
+#define PREFIX_LENGTH (MAGIC_LENGTH + CX9R_SHA256_HASH_LENGTH + 8 + 8 \
+		+ CX9R_AES256_BLOCK_LENGTH + 8)
+#define MAC_LENGTH CX9R_SHA256_HASH_LENGTH
+#define UUID_WORDS (CX9R_UUID_LENGTH / 4)
+
+static uint8_t const magic[MAGIC_LENGTH] = {'C', 'X', '9', 'R', 'S', 'N', 'P', '2'};
+
+// kinds of node records
+enum {
+	RECORD_GROUP = 1,	// depth, name, uuid
+	RECORD_ENTRY,		// name, uuid
+	RECORD_FIELD		// name id, value, protected
+};
+
+#define NO_STRING 0xffffffffu
+
+// memset through a volatile pointer so that wiping memory that is about
+// to be freed is not optimized away
+static void *(*const volatile wipe)(void *, int, size_t) = memset;
+
+typedef struct {
+	uint8_t *data;
+	size_t length;
+	size_t capacity;
+} buffer;
+
+// grow a buffer without leaving copies of its contents behind
+static int buffer_reserve(buffer *b, size_t n) {
+	uint8_t *data;
+	size_t capacity = b->capacity ? b->capacity : 4096;
+
+	if (b->capacity - b->length >= n) return 1;
+	while (capacity - b->length < n) capacity *= 2;
+	if ((data = malloc(capacity)) == NULL) return 0;
+	if (b->data != NULL) {
+		memcpy(data, b->data, b->length);
+		wipe(b->data, 0, b->capacity);
+		free(b->data);
+	}
+	b->data = data;
+	b->capacity = capacity;
+	return 1;
+}
+
+static int buffer_put(buffer *b, void const *p, size_t n) {
+	if (!buffer_reserve(b, n)) return 0;
+	memcpy(b->data + b->length, p, n);
+	b->length += n;
+	return 1;
+}
+
+static int buffer_put_u32(buffer *b, uint32_t v) {
+	uint8_t le[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16),
+			(uint8_t)(v >> 24)};
+	return buffer_put(b, le, sizeof(le));
+}
+
+static void buffer_free(buffer *b) {
+	if (b->data != NULL) {
+		wipe(b->data, 0, b->capacity);
+		free(b->data);
+	}
+	b->data = NULL;
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+	int i;
+	for (i = 0; i < 8; i++) p[i] = (uint8_t)(v >> 8 * i);
+}
+
+static uint32_t get_u32(uint8_t const *p) {
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+			| (uint32_t)p[3] << 24;
+}
+
+// encryption and authentication keys, bound to the master key
+static cx9r_err derive_keys(uint8_t const *master_key, uint8_t *enc_key,
+		uint8_t *mac_key) {
+	uint8_t buf[CX9R_AES256_KEY_LENGTH + 1];
+	cx9r_err err;
+
+	memcpy(buf, master_key, CX9R_AES256_KEY_LENGTH);
+	buf[CX9R_AES256_KEY_LENGTH] = 1;
+	if ((err = cx9r_sha256_hash_buffer(enc_key, buf, sizeof(buf))) == CX9R_OK) {
+		buf[CX9R_AES256_KEY_LENGTH] = 2;
+		err = cx9r_sha256_hash_buffer(mac_key, buf, sizeof(buf));
+	}
+	wipe(buf, 0, sizeof(buf));
+	return err;
+}
+
+static void write_prefix(uint8_t *p, cx9r_snapshot_id const *id,
+		uint8_t const *iv, uint64_t payload_length) {
+	memcpy(p, magic, MAGIC_LENGTH);
+	p += MAGIC_LENGTH;
+	memcpy(p, id->header_hash, CX9R_SHA256_HASH_LENGTH);
+	p += CX9R_SHA256_HASH_LENGTH;
+	put_u64(p, (uint64_t)id->mtime);
+	put_u64(p + 8, id->size);
+	memcpy(p + 16, iv, CX9R_AES256_BLOCK_LENGTH);
+	put_u64(p + 16 + CX9R_AES256_BLOCK_LENGTH, payload_length);
+}
+
+// append a string to the heap and its offset to the records
+static int put_string(buffer *heap, buffer *records, char const *s) {
+	uint32_t offset = NO_STRING;
+	size_t n;
+
+	if (s != NULL) {
+		n = strlen(s) + 1;
+		if (heap->length + n >= NO_STRING) return 0;
+		offset = (uint32_t)heap->length;
+		if (!buffer_put(heap, s, n)) return 0;
+	}
+	return buffer_put_u32(records, offset);
+}
+
+static int put_uuid(buffer *records, uint8_t const *uuid) {
+	return buffer_put(records, uuid, CX9R_UUID_LENGTH);
+}
+
+// serialize the counts, field names and nodes of a tree in pre-order
+static int serialize(cx9r_key_tree *kt, buffer *heap, buffer *records) {
+	cx9r_kt_iter it;
+	buffer nodes = {NULL, 0, 0};
+	uint32_t counts[3] = {0, 0, 0};
+	size_t i;
+	int ok = 1;
+	int event;
+
+	cx9r_kt_iter_init(&it, &kt->root, CX9R_KT_ITER_FIELDS);
+	while (ok && (event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		counts[event - CX9R_KT_ITER_GROUP]++;
+		switch (event) {
+		case CX9R_KT_ITER_GROUP:
+			ok = buffer_put_u32(&nodes, RECORD_GROUP)
+					&& buffer_put_u32(&nodes, (uint32_t)it.depth)
+					&& put_string(heap, &nodes, it.group->name)
+					&& put_uuid(&nodes, it.group->uuid);
+			break;
+		case CX9R_KT_ITER_ENTRY:
+			ok = buffer_put_u32(&nodes, RECORD_ENTRY)
+					&& put_string(heap, &nodes, it.entry->name)
+					&& put_uuid(&nodes, it.entry->uuid);
+			break;
+		case CX9R_KT_ITER_FIELD:
+			ok = buffer_put_u32(&nodes, RECORD_FIELD)
+					&& buffer_put_u32(&nodes, it.field->id >= 0
+							? (uint32_t)it.field->id : NO_STRING)
+					&& put_string(heap, &nodes, it.field->value)
+					&& buffer_put_u32(&nodes, (uint32_t)it.field->protected);
+			break;
+		}
+	}
+
+	ok = ok && buffer_put_u32(records, (uint32_t)kt->atoms.n_names)
+			&& buffer_put_u32(records, counts[0])
+			&& buffer_put_u32(records, counts[1])
+			&& buffer_put_u32(records, counts[2]);
+	for (i = CX9R_N_STD_FIELDS; ok && i < kt->atoms.n_names; i++) {
+		ok = put_string(heap, records, kt->atoms.names[i]);
+	}
+	ok = ok && buffer_put(records, nodes.data, nodes.length);
+	buffer_free(&nodes);
+	return ok;
+}
+
+cx9r_err cx9r_snapshot_save(char const *path, cx9r_key_tree *kt,
+		uint8_t const *master_key, cx9r_snapshot_id const *id) {
+	buffer heap = {NULL, 0, 0};
+	buffer records = {NULL, 0, 0};
+	buffer out = {NULL, 0, 0};
+	uint8_t enc_key[CX9R_SHA256_HASH_LENGTH];
+	uint8_t mac_key[CX9R_SHA256_HASH_LENGTH];
+	uint8_t iv[CX9R_AES256_BLOCK_LENGTH];
+	uint8_t prefix[PREFIX_LENGTH];
+	uint8_t mac[MAC_LENGTH];
+	cx9r_aes256_ctr_ctx aes_ctx;
+	char *tmp_path;
+	size_t payload_length;
+	FILE *f;
+	int fd;
+	cx9r_err err = CX9R_OK;
+
+	CHECK((serialize(kt, &heap, &records)), err, CX9R_MEM_ALLOC_ERR, cleanup);
+
+	payload_length = 4 + heap.length + records.length;
+	gcry_create_nonce(iv, sizeof(iv));
+	write_prefix(prefix, id, iv, payload_length);
+	CHECK((buffer_put(&out, prefix, PREFIX_LENGTH)
+			&& buffer_put_u32(&out, (uint32_t)heap.length)
+			&& buffer_put(&out, heap.data, heap.length)
+			&& buffer_put(&out, records.data, records.length)),
+			err, CX9R_MEM_ALLOC_ERR, cleanup);
+
+	CHEQ(((err = derive_keys(master_key, enc_key, mac_key)) == CX9R_OK), cleanup);
+	CHEQ(((err = cx9r_aes256_ctr_init(&aes_ctx, enc_key, iv)) == CX9R_OK),
+			cleanup);
+	err = cx9r_aes256_ctr_crypt(&aes_ctx, out.data + PREFIX_LENGTH, payload_length);
+	cx9r_aes256_ctr_close(&aes_ctx);
+	CHEQ((err == CX9R_OK), cleanup);
+	CHEQ(((err = cx9r_hmac_sha256(mac, mac_key, sizeof(mac_key), out.data,
+			out.length)) == CX9R_OK), cleanup);
+	CHECK((buffer_put(&out, mac, MAC_LENGTH)), err, CX9R_MEM_ALLOC_ERR, cleanup);
+
+	// write to a temporary file, so that readers never see a partial one
+	CHECK(((tmp_path = malloc(strlen(path) + 5)) != NULL), err,
+			CX9R_MEM_ALLOC_ERR, cleanup);
+	strcpy(tmp_path, path);
+	strcat(tmp_path, ".tmp");
+	err = CX9R_FILE_READ_ERR;
+	if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0) {
+		if ((f = fdopen(fd, "wb")) == NULL) {
+			close(fd);
+		}
+		else if ((fwrite(out.data, 1, out.length, f) == out.length)
+				& (fclose(f) == 0) && rename(tmp_path, path) == 0) {
+			err = CX9R_OK;
+		}
+		if (err != CX9R_OK) unlink(tmp_path);
+	}
+	free(tmp_path);
+
+cleanup:
+
+	wipe(enc_key, 0, sizeof(enc_key));
+	wipe(mac_key, 0, sizeof(mac_key));
+	buffer_free(&heap);
+	buffer_free(&records);
+	buffer_free(&out);
+	return err;
+}
+
+// look a string up in the copy of the heap
+static int get_string(char *strings, uint32_t heap_length, uint32_t offset,
+		char **s) {
+	if (offset == NO_STRING) {
+		*s = NULL;
+		return 1;
+	}
+	if (offset >= heap_length) return 0;
+	*s = strings + offset;
+	return 1;
+}
+
+// rebuild a tree from the decrypted payload: the strings are copied into
+// the tree at once, and the nodes are filled in and linked in place
+static cx9r_err deserialize(uint8_t const *p, size_t length, cx9r_key_tree **kt) {
+	uint8_t const *end = p + length;
+	uint32_t heap_length;
+	uint32_t n_names;
+	uint32_t counts[3];
+	char *strings;
+	cx9r_kt_group *groups;
+	cx9r_kt_entry *entries;
+	cx9r_kt_field *fields;
+	size_t n[3] = {0, 0, 0};
+	cx9r_kt_group **path = NULL;
+	size_t path_capacity = 0;
+	size_t depth;
+	size_t last_depth = 0;
+	cx9r_kt_group **t;
+	cx9r_kt_group *parent;
+	cx9r_kt_group *g = NULL;
+	cx9r_kt_entry *e = NULL;
+	cx9r_kt_field *f;
+	char *name;
+	uint32_t id;
+	size_t i;
+	cx9r_err err = CX9R_OK;
+
+	CHECK((length >= 4), err, CX9R_SNAPSHOT_MISS, bail);
+	heap_length = get_u32(p);
+	p += 4;
+	CHECK((heap_length <= (size_t)(end - p)), err, CX9R_SNAPSHOT_MISS, bail);
+	// every string must be terminated within the heap
+	CHECK((heap_length == 0 || p[heap_length - 1] == 0), err,
+			CX9R_SNAPSHOT_MISS, bail);
+
+	CHECK(((*kt = cx9r_key_tree_create()) != NULL), err, CX9R_MEM_ALLOC_ERR, bail);
+	CHECK(((strings = cx9r_arena_alloc(&(*kt)->arena, heap_length + 1)) != NULL),
+			err, CX9R_MEM_ALLOC_ERR, dealloc_key_tree);
+	memcpy(strings, p, heap_length);
+	p += heap_length;
+
+	CHECK((end - p >= 16), err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+	n_names = get_u32(p);
+	for (i = 0; i < 3; i++) {
+		counts[i] = get_u32(p + 4 + 4 * i);
+		// each node takes at least 16 bytes, which bounds the counts
+		CHECK((counts[i] <= (size_t)(end - p) / 16), err, CX9R_SNAPSHOT_MISS,
+				dealloc_key_tree);
+	}
+	p += 16;
+	CHECK((n_names >= CX9R_N_STD_FIELDS && counts[0] > 0
+			&& (size_t)(end - p) / 4 >= n_names - CX9R_N_STD_FIELDS), err,
+			CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+	// interning the names in order gives them the ids they had
+	for (i = CX9R_N_STD_FIELDS; i < n_names; i++, p += 4) {
+		CHECK((get_string(strings, heap_length, get_u32(p), &name)
+				&& name != NULL), err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+		id = (uint32_t)cx9r_key_tree_intern(*kt, name, strlen(name));
+		CHECK((id != (uint32_t)CX9R_FIELD_NONE), err, CX9R_MEM_ALLOC_ERR,
+				dealloc_key_tree);
+		CHECK((id == i), err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+	}
+
+	// all nodes but the root, zeroed so that only what is set differs
+	CHECK(((groups = cx9r_arena_alloc(&(*kt)->arena,
+			(counts[0] - 1) * sizeof(cx9r_kt_group))) != NULL
+			&& (entries = cx9r_arena_alloc(&(*kt)->arena,
+					counts[1] * sizeof(cx9r_kt_entry))) != NULL
+			&& (fields = cx9r_arena_alloc(&(*kt)->arena,
+					counts[2] * sizeof(cx9r_kt_field))) != NULL),
+			err, CX9R_MEM_ALLOC_ERR, dealloc_key_tree);
+	memset(groups, 0, (counts[0] - 1) * sizeof(cx9r_kt_group));
+	memset(entries, 0, counts[1] * sizeof(cx9r_kt_entry));
+	memset(fields, 0, counts[2] * sizeof(cx9r_kt_field));
+
+	while (p < end) {
+		CHECK((end - p >= 4), err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+		switch (get_u32(p)) {
+		case RECORD_GROUP:
+			CHECK((end - p >= 12 + CX9R_UUID_LENGTH && n[0] < counts[0]), err,
+					CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			depth = get_u32(p + 4);
+			CHECK((get_string(strings, heap_length, get_u32(p + 8), &name)), err,
+					CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			// the root comes first, every other group right below
+			// one of the groups on the path to the previous one
+			CHECK(((g == NULL) == (depth == 0) && depth <= last_depth + 1), err,
+					CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			if (depth == path_capacity) {
+				path_capacity = path_capacity ? 2 * path_capacity : 64;
+				CHECK(((t = realloc(path, path_capacity
+						* sizeof(cx9r_kt_group*))) != NULL), err,
+						CX9R_MEM_ALLOC_ERR, dealloc_key_tree);
+				path = t;
+			}
+			if (depth == 0) {
+				g = cx9r_key_tree_get_root(*kt);
+			}
+			else {
+				g = &groups[n[0] - 1];
+				parent = path[depth - 1];
+				g->tree = *kt;
+				g->depth = (int)depth;
+				g->parent = parent;
+				g->path_length = (parent->parent != NULL ? parent->path_length + 1 : 0)
+						+ (name != NULL ? strlen(name) : 0);
+				if (parent->children_tail == NULL) parent->children = g;
+				else parent->children_tail->next = g;
+				parent->children_tail = g;
+				parent->n_children++;
+			}
+			n[0]++;
+			g->name = name;
+			memcpy(g->uuid, p + 12, CX9R_UUID_LENGTH);
+			path[depth] = g;
+			last_depth = depth;
+			e = NULL;
+			p += 12 + CX9R_UUID_LENGTH;
+			break;
+		case RECORD_ENTRY:
+			CHECK((end - p >= 8 + CX9R_UUID_LENGTH && g != NULL
+					&& n[1] < counts[1]), err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			CHECK((get_string(strings, heap_length, get_u32(p + 4), &name)), err,
+					CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			e = &entries[n[1]++];
+			e->tree = *kt;
+			e->name = name;
+			memcpy(e->uuid, p + 8, CX9R_UUID_LENGTH);
+			if (g->entries_tail == NULL) g->entries = e;
+			else g->entries_tail->next = e;
+			g->entries_tail = e;
+			g->n_entries++;
+			p += 8 + CX9R_UUID_LENGTH;
+			break;
+		case RECORD_FIELD:
+			CHECK((end - p >= 16 && e != NULL && n[2] < counts[2]), err,
+					CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			id = get_u32(p + 4);
+			CHECK((id == NO_STRING || id < n_names), err, CX9R_SNAPSHOT_MISS,
+					dealloc_key_tree);
+			f = &fields[n[2]++];
+			CHECK((get_string(strings, heap_length, get_u32(p + 8), &f->value)),
+					err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+			f->entry = e;
+			f->id = id == NO_STRING ? CX9R_FIELD_NONE : (int)id;
+			f->name = f->id >= 0 ? (*kt)->atoms.names[f->id] : NULL;
+			f->protected = get_u32(p + 12) != 0;
+			// the standard field slots point to the first field of each name
+			if (f->id >= 0 && f->id < CX9R_N_STD_FIELDS
+					&& e->std_fields[f->id] == NULL) {
+				e->std_fields[f->id] = f;
+			}
+			if (e->fields_tail == NULL) e->fields = f;
+			else e->fields_tail->next = f;
+			e->fields_tail = f;
+			p += 16;
+			break;
+		default:
+			CHECK((0), err, CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+		}
+	}
+
+	CHECK((n[0] == counts[0] && n[1] == counts[1] && n[2] == counts[2]), err,
+			CX9R_SNAPSHOT_MISS, dealloc_key_tree);
+	CHECK((cx9r_key_tree_index_uuids(*kt)), err, CX9R_MEM_ALLOC_ERR,
+			dealloc_key_tree);
+	goto bail;
+
+dealloc_key_tree:
+
+	cx9r_key_tree_free(*kt);
+	*kt = NULL;
+
+bail:
+
+	free(path);
+	return err;
+}
+
+cx9r_err cx9r_snapshot_load(char const *path, uint8_t const *master_key,
+		cx9r_snapshot_id const *id, cx9r_key_tree **kt) {
+	uint8_t enc_key[CX9R_SHA256_HASH_LENGTH];
+	uint8_t mac_key[CX9R_SHA256_HASH_LENGTH];
+	uint8_t mac[MAC_LENGTH];
+	uint8_t expected[PREFIX_LENGTH];
+	cx9r_aes256_ctr_ctx aes_ctx;
+	struct stat st;
+	uint8_t *data;
+	size_t length;
+	size_t payload_length;
+	uint8_t diff = 0;
+	size_t i;
+	FILE *f;
+	cx9r_err err = CX9R_SNAPSHOT_MISS;
+
+	*kt = NULL;
+	if ((f = fopen(path, "rb")) == NULL) return CX9R_SNAPSHOT_MISS;
+	CHEQ((fstat(fileno(f), &st) == 0 && st.st_size >= PREFIX_LENGTH + MAC_LENGTH),
+			close_file);
+	length = (size_t)st.st_size;
+	CHECK(((data = malloc(length)) != NULL), err, CX9R_MEM_ALLOC_ERR, close_file);
+	// the whole snapshot is taken in with a single read
+	CHEQ((fread(data, 1, length, f) == length), cleanup);
+
+	// the iv is the only part of the prefix not known in advance
+	payload_length = length - PREFIX_LENGTH - MAC_LENGTH;
+	write_prefix(expected, id, data + PREFIX_LENGTH - 8 - CX9R_AES256_BLOCK_LENGTH,
+			payload_length);
+	CHEQ((memcmp(data, expected, PREFIX_LENGTH) == 0), cleanup);
+
+	CHEQ(((err = derive_keys(master_key, enc_key, mac_key)) == CX9R_OK), cleanup);
+	CHEQ(((err = cx9r_hmac_sha256(mac, mac_key, sizeof(mac_key), data,
+			length - MAC_LENGTH)) == CX9R_OK), cleanup);
+	for (i = 0; i < MAC_LENGTH; i++) diff |= mac[i] ^ data[length - MAC_LENGTH + i];
+	CHECK((diff == 0), err, CX9R_SNAPSHOT_MISS, cleanup);
+
+	CHEQ(((err = cx9r_aes256_ctr_init(&aes_ctx, enc_key,
+			data + PREFIX_LENGTH - 8 - CX9R_AES256_BLOCK_LENGTH)) == CX9R_OK),
+			cleanup);
+	err = cx9r_aes256_ctr_crypt(&aes_ctx, data + PREFIX_LENGTH, payload_length);
+	cx9r_aes256_ctr_close(&aes_ctx);
+	CHEQ((err == CX9R_OK), cleanup);
+
+	err = deserialize(data + PREFIX_LENGTH, payload_length, kt);
+
+cleanup:
+
+	wipe(enc_key, 0, sizeof(enc_key));
+	wipe(mac_key, 0, sizeof(mac_key));
+	wipe(data, 0, length);
+	free(data);
+
+close_file:
+
+	fclose(f);
+	return err;
+}
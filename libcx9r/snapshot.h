@@ -0,0 +1,63 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_SNAPSHOT_H
+#define CX9R_SNAPSHOT_H
+
+#include <cx9r.h>
+#include <stdint.h>
+#include "key_tree.h"
+#include "aes256.h"
+#include "sha256.h"
+
+/// Identifies the database file a snapshot was taken of. A snapshot is
+/// only used while all of these still match the file.
+typedef struct {
+	uint8_t header_hash[CX9R_SHA256_HASH_LENGTH];	// of the kdbx header
+	int64_t mtime;
+	uint64_t size;
+} cx9r_snapshot_id;
+
+/**
+ * Save a key tree as an encrypted, authenticated snapshot. The file is
+ * written next to path and renamed into place, readable by the owner only.
+ * @param path snapshot file
+ * @param kt key tree
+ * @param master_key master key of the database, CX9R_AES256_KEY_LENGTH
+ * bytes, from which the snapshot keys are derived
+ * @param id identity of the database file
+ * @return CX9R_OK on success, an error code otherwise
+ */
+cx9r_err cx9r_snapshot_save(char const *path, cx9r_key_tree *kt,
+		uint8_t const *master_key, cx9r_snapshot_id const *id);
+
+/**
+ * Load a key tree from a snapshot.
+ * @param path snapshot file
+ * @param master_key master key of the database
+ * @param id identity the database file has now
+ * @param kt set to the loaded tree
+ * @return CX9R_OK on success, CX9R_SNAPSHOT_MISS if there is no snapshot,
+ * it was taken of another state of the file, or it was not made with this
+ * master key; another error code otherwise
+ */
+cx9r_err cx9r_snapshot_load(char const *path, uint8_t const *master_key,
+		cx9r_snapshot_id const *id, cx9r_key_tree **kt);
+
+#endif
@@ -0,0 +1,173 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+#include "key_tree.h"
+#include <stdio.h>
+#include <string.h>
+
+#define N_ENTRIES 100
+
+// compare two trees node by node
+static int same_tree(cx9r_key_tree *a, cx9r_key_tree *b) {
+	cx9r_kt_iter i;
+	cx9r_kt_iter j;
+	int event;
+
+	cx9r_kt_iter_init(&i, cx9r_key_tree_get_root(a), CX9R_KT_ITER_FIELDS);
+	cx9r_kt_iter_init(&j, cx9r_key_tree_get_root(b), CX9R_KT_ITER_FIELDS);
+	while ((event = cx9r_kt_iter_next(&i)) != CX9R_KT_ITER_END) {
+		if (cx9r_kt_iter_next(&j) != event || i.depth != j.depth) return 0;
+		switch (event) {
+		case CX9R_KT_ITER_GROUP:
+			if ((i.group->name == NULL) != (j.group->name == NULL)) return 0;
+			if (i.group->name != NULL && strcmp(i.group->name, j.group->name) != 0)
+				return 0;
+			if (memcmp(i.group->uuid, j.group->uuid, CX9R_UUID_LENGTH) != 0)
+				return 0;
+			break;
+		case CX9R_KT_ITER_ENTRY:
+			if (strcmp(i.entry->name, j.entry->name) != 0) return 0;
+			if (memcmp(i.entry->uuid, j.entry->uuid, CX9R_UUID_LENGTH) != 0)
+				return 0;
+			break;
+		case CX9R_KT_ITER_FIELD:
+			if (i.field->name != NULL && strcmp(i.field->name, j.field->name) != 0)
+				return 0;
+			if ((i.field->value == NULL) != (j.field->value == NULL)) return 0;
+			if (i.field->value != NULL && strcmp(i.field->value, j.field->value) != 0)
+				return 0;
+			if (i.field->protected != j.field->protected) return 0;
+			break;
+		}
+	}
+	return cx9r_kt_iter_next(&j) == CX9R_KT_ITER_END;
+}
+
+int main() {
+
+	cx9r_key_tree *kt;
+	cx9r_key_tree *loaded = NULL;
+	cx9r_kt_group *g;
+	cx9r_kt_entry *e;
+	cx9r_kt_field *f;
+	cx9r_kt_group *found_group;
+	cx9r_kt_entry *found_entry;
+	cx9r_snapshot_id id;
+	uint8_t key[CX9R_AES256_KEY_LENGTH];
+	uint8_t uuid[CX9R_UUID_LENGTH];
+	char name[16];
+	FILE *file;
+	int i;
+
+	printf("building key tree...");
+	if ((kt = cx9r_key_tree_create()) == NULL) goto bail;
+	g = cx9r_key_tree_get_root(kt);
+	if (cx9r_kt_group_set_zname(g, "Root") == NULL) goto dealloc_tree;
+	memset(uuid, 0, CX9R_UUID_LENGTH);
+	for (i = 0; i < N_ENTRIES; i++) {
+		// a new group every ten entries, each below the previous one
+		if (i % 10 == 0) {
+			if ((g = cx9r_kt_group_add_child(g)) == NULL) goto dealloc_tree;
+			sprintf(name, "group%d", i / 10);
+			if (cx9r_kt_group_set_zname(g, name) == NULL) goto dealloc_tree;
+		}
+		if ((e = cx9r_kt_group_add_entry(g)) == NULL) goto dealloc_tree;
+		sprintf(name, "entry%d", i);
+		if (cx9r_kt_entry_set_zname(e, name) == NULL) goto dealloc_tree;
+		uuid[0] = (uint8_t)(i + 1);
+		cx9r_kt_entry_set_uuid(e, uuid);
+		if ((f = cx9r_kt_entry_add_field(e)) == NULL) goto dealloc_tree;
+		if (cx9r_kt_field_set_zname(f, "Password") == NULL) goto dealloc_tree;
+		if (cx9r_kt_field_set_zvalue(f, name) == NULL) goto dealloc_tree;
+		cx9r_kt_field_set_protected(f, 1);
+		if ((f = cx9r_kt_entry_add_field(e)) == NULL) goto dealloc_tree;
+		if (cx9r_kt_field_set_zname(f, "Custom") == NULL) goto dealloc_tree;
+	}
+	printf("ok\n");
+
+	memset(key, 7, sizeof(key));
+	memset(&id, 0, sizeof(id));
+	id.mtime = 1234567890;
+	id.size = 4711;
+
+	printf("save and load...");
+	if (cx9r_snapshot_save(TESTFILE, kt, key, &id) != CX9R_OK) goto dealloc_tree;
+	if (cx9r_snapshot_load(TESTFILE, key, &id, &loaded) != CX9R_OK)
+		goto remove_file;
+	if (!same_tree(kt, loaded)) goto remove_file;
+	uuid[0] = 42;
+	if (!cx9r_key_tree_find_uuid(loaded, uuid, &found_group, &found_entry)
+			|| strcmp(cx9r_kt_entry_get_name(found_entry), "entry41") != 0)
+		goto remove_file;
+	cx9r_key_tree_free(loaded);
+	loaded = NULL;
+	printf("ok\n");
+
+	printf("changed file...");
+	id.size++;
+	if (cx9r_snapshot_load(TESTFILE, key, &id, &loaded) != CX9R_SNAPSHOT_MISS)
+		goto remove_file;
+	id.size--;
+	printf("ok\n");
+
+	printf("wrong key...");
+	key[0] ^= 1;
+	if (cx9r_snapshot_load(TESTFILE, key, &id, &loaded) != CX9R_SNAPSHOT_MISS)
+		goto remove_file;
+	key[0] ^= 1;
+	printf("ok\n");
+
+	printf("tampered snapshot...");
+	if ((file = fopen(TESTFILE, "r+b")) == NULL) goto remove_file;
+	fseek(file, -40, SEEK_END);
+	i = fgetc(file);
+	fseek(file, -40, SEEK_END);
+	fputc(i ^ 1, file);
+	fclose(file);
+	if (cx9r_snapshot_load(TESTFILE, key, &id, &loaded) != CX9R_SNAPSHOT_MISS)
+		goto remove_file;
+	printf("ok\n");
+
+	printf("missing snapshot...");
+	remove(TESTFILE);
+	if (cx9r_snapshot_load(TESTFILE, key, &id, &loaded) != CX9R_SNAPSHOT_MISS)
+		goto dealloc_tree;
+	printf("ok\n");
+
+	cx9r_key_tree_free(kt);
+
+	printf("All snapshot tests passed\n");
+
+	return 0;
+
+remove_file:
+
+	remove(TESTFILE);
+	if (loaded != NULL) cx9r_key_tree_free(loaded);
+
+dealloc_tree:
+
+	cx9r_key_tree_free(kt);
+
+bail:
+
+	printf("fail\n");
+	return 1;
+}
@@ -21,6 +21,7 @@
 #include "aes256.h"
 #include "sha256.h"
 #include "util.h"
+#include "mem_stats.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <zlib.h>
@@ -381,7 +382,7 @@ static int aes256_cbc_sclose(cx9r_stream_t *stream) {
 
 	cx9r_aes256_cbc_close(ctx);
 	free(ctx);
-	free(data);
+	cx9r_mem_free(CX9R_MEM_DECRYPT, data);
 	free(stream);
 	return cx9r_sclose(in);
 
@@ -396,8 +397,8 @@ cx9r_stream_t *cx9r_aes256_cbc_sopen(cx9r_stream_t *in, void *key, void* iv) {
 	CHEQ(((stream = malloc(sizeof(cx9r_stream_t))) != NULL),
 			bail);
 
-	CHEQ(((stream->data = data = malloc(sizeof(aes256_cbc_data_t))) != NULL),
-			cleanup_stream);
+	CHEQ(((stream->data = data = cx9r_mem_alloc(CX9R_MEM_DECRYPT,
+			sizeof(aes256_cbc_data_t))) != NULL), cleanup_stream);
 
 	CHEQ(((data->ctx = ctx = malloc(sizeof(cx9r_aes256_cbc_ctx))) != NULL),
 			cleanup_data);
@@ -427,7 +428,7 @@ cleanup_ctx:
 
 cleanup_data:
 
-	free(data);
+	cx9r_mem_free(CX9R_MEM_DECRYPT, data);
 
 cleanup_stream:
 
@@ -504,23 +505,23 @@ static size_t hash_sread(void *ptr, size_t size, size_t nmemb,
 				break;
 			}
 			if (data->buf != NULL) {
-				free(data->buf);
+				cx9r_mem_free(CX9R_MEM_DECRYPT, data->buf);
 				data->buf = NULL;
 			}
-			if ((data->buf = malloc(buf_length)) == NULL) {
+			if ((data->buf = cx9r_mem_alloc(CX9R_MEM_DECRYPT, buf_length)) == NULL) {
 				data->error = 1;
 				break;
 			}
 			if (cx9r_sread(data->buf, 1, buf_length, data->in) != buf_length) {
 				data->error = 1;
-				free(data->buf);
+				cx9r_mem_free(CX9R_MEM_DECRYPT, data->buf);
 				data->buf = NULL;
 				break;
 			}
 			cx9r_sha256_hash_buffer(comp_hash, data->buf, buf_length);
 			if (memcmp(comp_hash, read_hash, CX9R_SHA256_HASH_LENGTH) != 0) {
 				data->error = 1;
-				free(data->buf);
+				cx9r_mem_free(CX9R_MEM_DECRYPT, data->buf);
 				data->buf = NULL;
 				break;
 			}
@@ -571,7 +572,7 @@ static int hash_sclose(cx9r_stream_t *stream) {
 	in = data->in;
 
 	if (data->buf != NULL) {
-		free(data->buf);
+		cx9r_mem_free(CX9R_MEM_DECRYPT, data->buf);
 	}
 	free(data);
 	free(stream);
@@ -761,13 +762,22 @@ static int gzip_sclose(cx9r_stream_t *stream) {
 	in = data->in;
 
 	inflateEnd(&data->zstrm);
-	free(data);
+	cx9r_mem_free(CX9R_MEM_GZIP, data);
 	free(stream);
 	return cx9r_sclose(in);
 }
 
 #define GZIP_WINDOW_BITS (15 + 16) // largest window size, only gzip decompression
 
+// allocator for the inflate state
+static voidpf gzip_zalloc(voidpf opaque, uInt items, uInt size) {
+	return cx9r_mem_alloc(CX9R_MEM_GZIP, (size_t)items * size);
+}
+
+static void gzip_zfree(voidpf opaque, voidpf address) {
+	cx9r_mem_free(CX9R_MEM_GZIP, address);
+}
+
 // open gzip encrypted stream
 cx9r_stream_t *cx9r_gzip_sopen(cx9r_stream_t *in) {
 	cx9r_stream_t *stream;
@@ -777,15 +787,15 @@ cx9r_stream_t *cx9r_gzip_sopen(cx9r_stream_t *in) {
 	CHEQ(((stream = malloc(sizeof(cx9r_stream_t))) != NULL),
 			bail);
 
-	CHEQ(((stream->data = data = malloc(sizeof(gzip_data_t))) != NULL),
-			cleanup_stream);
+	CHEQ(((stream->data = data = cx9r_mem_alloc(CX9R_MEM_GZIP,
+			sizeof(gzip_data_t))) != NULL), cleanup_stream);
 
 	data->in = in;
 	data->eof = 0;
 	data->error = 0;
 	zstrm = &data->zstrm;
-	zstrm->zalloc = Z_NULL;
-	zstrm->zfree = Z_NULL;
+	zstrm->zalloc = gzip_zalloc;
+	zstrm->zfree = gzip_zfree;
 	zstrm->opaque = Z_NULL;
 	zstrm->avail_in = 0;
 	zstrm->next_in = Z_NULL;
@@ -800,7 +810,7 @@ cx9r_stream_t *cx9r_gzip_sopen(cx9r_stream_t *in) {
 
 cleanup_data:
 
-	free(data);
+	cx9r_mem_free(CX9R_MEM_GZIP, data);
 
 cleanup_stream:
 
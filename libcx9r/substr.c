@@ -0,0 +1,149 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Candidate positions are found 16 at a time by comparing the first and
+// last byte of the pattern with SSE2; only positions where both match
+// are compared in full. Short strings and the tail of long ones, which
+// are too short for a full vector, use Horspool.
+#include "substr.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define SUBSTR_SSE2
+#endif
+
+#define VECTOR_LENGTH 16
+
+static uint8_t fold(uint8_t c) {
+	return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+static uint8_t other_case(uint8_t c) {
+	return (c >= 'a' && c <= 'z') ? c & ~0x20 : c;
+}
+
+int cx9r_substr_compile(cx9r_substr *s, char const *pattern, int flags) {
+	size_t i;
+	uint8_t c;
+
+	s->length = strlen(pattern);
+	s->flags = flags;
+	if ((s->pattern = malloc(s->length + 1)) == NULL) {
+		return 0;
+	}
+	for (i = 0; i <= s->length; i++) {
+		s->pattern[i] = flags & CX9R_SUBSTR_IGNORE_CASE ?
+				fold(pattern[i]) : pattern[i];
+	}
+
+	if (s->length > 0) {
+		s->first[0] = s->first[1] = s->pattern[0];
+		s->last[0] = s->last[1] = s->pattern[s->length - 1];
+		if (flags & CX9R_SUBSTR_IGNORE_CASE) {
+			s->first[1] = other_case(s->first[0]);
+			s->last[1] = other_case(s->last[0]);
+		}
+	}
+
+	for (i = 0; i < 256; i++) {
+		s->shift[i] = s->length;
+	}
+	for (i = 0; i + 1 < s->length; i++) {
+		c = s->pattern[i];
+		s->shift[c] = s->length - 1 - i;
+		if (flags & CX9R_SUBSTR_IGNORE_CASE) {
+			s->shift[other_case(c)] = s->length - 1 - i;
+		}
+	}
+	return 1;
+}
+
+void cx9r_substr_free(cx9r_substr *s) {
+	free(s->pattern);
+	s->pattern = NULL;
+}
+
+// compare the pattern with the string at p
+static int equal_at(cx9r_substr const *s, uint8_t const *p) {
+	size_t i;
+
+	if (!(s->flags & CX9R_SUBSTR_IGNORE_CASE)) {
+		return memcmp(p, s->pattern, s->length) == 0;
+	}
+	for (i = 0; i < s->length; i++) {
+		if (fold(p[i]) != (uint8_t)s->pattern[i]) return 0;
+	}
+	return 1;
+}
+
+static char const *find_horspool(cx9r_substr const *s, uint8_t const *h,
+		size_t length) {
+	size_t i = 0;
+
+	while (i + s->length <= length) {
+		if (equal_at(s, h + i)) return (char const*)h + i;
+		i += s->shift[h[i + s->length - 1]];
+	}
+	return NULL;
+}
+
+char const *cx9r_substr_find(cx9r_substr const *s, char const *haystack,
+		size_t length) {
+	uint8_t const *h = (uint8_t const*)haystack;
+	size_t i = 0;
+
+	if (s->length == 0) return haystack;
+	if (s->length > length) return NULL;
+
+#ifdef SUBSTR_SSE2
+	{
+		__m128i const first0 = _mm_set1_epi8((char)s->first[0]);
+		__m128i const first1 = _mm_set1_epi8((char)s->first[1]);
+		__m128i const last0 = _mm_set1_epi8((char)s->last[0]);
+		__m128i const last1 = _mm_set1_epi8((char)s->last[1]);
+		__m128i block_first;
+		__m128i block_last;
+		unsigned mask;
+
+		for (; i + s->length - 1 + VECTOR_LENGTH <= length; i += VECTOR_LENGTH) {
+			block_first = _mm_loadu_si128((__m128i const*)(h + i));
+			block_last = _mm_loadu_si128((__m128i const*)(h + i + s->length - 1));
+			mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(block_first, first0),
+							_mm_cmpeq_epi8(block_first, first1)),
+					_mm_or_si128(_mm_cmpeq_epi8(block_last, last0),
+							_mm_cmpeq_epi8(block_last, last1))));
+			while (mask != 0) {
+				if (equal_at(s, h + i + __builtin_ctz(mask))) {
+					return haystack + i + __builtin_ctz(mask);
+				}
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+
+	return find_horspool(s, h + i, length - i);
+}
+
+int cx9r_substr_contains(cx9r_substr const *s, char const *haystack) {
+	if (haystack == NULL) return 0;
+	return cx9r_substr_find(s, haystack, strlen(haystack)) != NULL;
+}
@@ -0,0 +1,74 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_SUBSTR_H
+#define CX9R_SUBSTR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// match ASCII letters regardless of case
+#define CX9R_SUBSTR_IGNORE_CASE 1
+
+/// Substring searcher for one pattern that is applied to many strings.
+typedef struct {
+	char *pattern;		// case folded if CX9R_SUBSTR_IGNORE_CASE is set
+	size_t length;
+	int flags;
+	// both cases of the first and last pattern byte
+	uint8_t first[2];
+	uint8_t last[2];
+	// Horspool shift for each byte value
+	size_t shift[256];
+} cx9r_substr;
+
+/**
+ * Prepare a pattern for searching.
+ * @param s searcher
+ * @param pattern zero terminated pattern
+ * @param flags CX9R_SUBSTR_IGNORE_CASE or 0
+ * @return 1 on success, 0 if allocation failed
+ */
+int cx9r_substr_compile(cx9r_substr *s, char const *pattern, int flags);
+
+/**
+ * Release the memory of a searcher.
+ * @param s searcher
+ */
+void cx9r_substr_free(cx9r_substr *s);
+
+/**
+ * Find the first occurrence of the pattern.
+ * @param s searcher
+ * @param haystack string to search
+ * @param length length of haystack
+ * @return pointer to the occurrence, or NULL if there is none
+ */
+char const *cx9r_substr_find(cx9r_substr const *s, char const *haystack,
+		size_t length);
+
+/**
+ * Check whether a zero terminated string contains the pattern.
+ * @param s searcher
+ * @param haystack string to search, may be NULL
+ * @return 1 if the pattern occurs, 0 if not
+ */
+int cx9r_substr_contains(cx9r_substr const *s, char const *haystack);
+
+#endif
@@ -0,0 +1,116 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "substr.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_HAYSTACK 100
+#define MAX_PATTERN 20
+#define N_ROUNDS 20000
+
+static uint32_t seed = 1;
+
+static uint32_t next_random() {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+// a small alphabet with both cases and non-ASCII bytes, so that
+// partial matches and case variants are frequent
+static void random_text(char *s, size_t length) {
+	static char const alphabet[] = "aAbB\xc3\xa4-";
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		s[i] = alphabet[next_random() % (sizeof(alphabet) - 1)];
+	}
+	s[length] = 0;
+}
+
+// reference: first occurrence by brute force
+static char const *naive_find(char const *h, size_t length, char const *p,
+		int ignore_case) {
+	size_t m = strlen(p);
+	size_t i;
+	size_t j;
+
+	for (i = 0; i + m <= length; i++) {
+		for (j = 0; j < m; j++) {
+			if (ignore_case ? tolower((unsigned char)h[i + j])
+					!= tolower((unsigned char)p[j]) : h[i + j] != p[j]) break;
+		}
+		if (j == m) return h + i;
+	}
+	return NULL;
+}
+
+int main() {
+
+	cx9r_substr s;
+	char haystack[MAX_HAYSTACK + 1];
+	char pattern[MAX_PATTERN + 1];
+	size_t length;
+	int flags;
+	int i;
+
+	printf("fixed patterns...");
+	if (!cx9r_substr_compile(&s, "World", 0)) goto fail;
+	if (!cx9r_substr_contains(&s, "Hello World")) goto free_fail;
+	if (cx9r_substr_contains(&s, "Hello world")) goto free_fail;
+	if (cx9r_substr_contains(&s, NULL)) goto free_fail;
+	cx9r_substr_free(&s);
+	if (!cx9r_substr_compile(&s, "World", CX9R_SUBSTR_IGNORE_CASE)) goto fail;
+	if (!cx9r_substr_contains(&s, "hello WORLD")) goto free_fail;
+	if (cx9r_substr_contains(&s, "hello WORL")) goto free_fail;
+	cx9r_substr_free(&s);
+	if (!cx9r_substr_compile(&s, "", 0)) goto fail;
+	if (!cx9r_substr_contains(&s, "")) goto free_fail;
+	cx9r_substr_free(&s);
+	printf("ok\n");
+
+	// lengths up to several vectors exercise the SIMD loop and its tail
+	printf("random patterns...");
+	for (i = 0; i < N_ROUNDS; i++) {
+		length = next_random() % (MAX_HAYSTACK + 1);
+		random_text(haystack, length);
+		random_text(pattern, next_random() % 4 == 0 ? next_random() % (MAX_PATTERN + 1)
+				: 1 + next_random() % 4);
+		flags = i % 2 ? CX9R_SUBSTR_IGNORE_CASE : 0;
+		if (!cx9r_substr_compile(&s, pattern, flags)) goto fail;
+		if (cx9r_substr_find(&s, haystack, length)
+				!= naive_find(haystack, length, pattern, flags)) goto free_fail;
+		cx9r_substr_free(&s);
+	}
+	printf("ok\n");
+
+	printf("All substring search tests passed\n");
+
+	return 0;
+
+	free_fail:
+
+	cx9r_substr_free(&s);
+
+	fail:
+
+	printf("fail\n");
+	return 1;
+}
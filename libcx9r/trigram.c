@@ -0,0 +1,507 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Trigram index: for every distinct trigram a sorted posting list of the
+// entries (or groups) whose text contains it. A search intersects the
+// lists of the trigrams of the pattern and verifies the remaining
+// candidates with the substring searcher, so the result is exact. The
+// trigrams are case folded, so that the same index serves searches that
+// ignore case.
+#include "trigram.h"
+#include <string.h>
+#include <pthread.h>
+
+typedef struct {
+	uint32_t *trigrams;	// distinct trigrams, sorted
+	uint32_t *offsets;	// postings of trigrams[i] are [offsets[i], offsets[i + 1])
+	uint32_t *postings;
+	size_t n_trigrams;
+} posting_table;
+
+typedef struct {
+	uint32_t entry;
+	char const *value;
+} protected_value;
+
+struct cx9r_trigram_index {
+	cx9r_kt_entry **entries;	// in iteration order
+	size_t n_entries;
+	cx9r_kt_group **groups;		// in iteration order
+	// entries in the subtree of groups[i] are [group_first[i], group_end[i])
+	uint32_t *group_first;
+	uint32_t *group_end;
+	size_t n_groups;
+	protected_value *protected_values;
+	size_t n_protected;
+	posting_table titles;	// entry titles
+	posting_table texts;	// entry titles and unprotected field values
+	posting_table names;	// group names
+	uint32_t *scratch;		// candidates of a search
+	int n_threads;
+};
+
+// items of work taken by a thread at a time
+#define PARALLEL_CHUNK 256
+// below this many items a search is not worth starting threads for
+#define PARALLEL_MIN_WORK 8192
+
+// (trigram, id) pairs collected while building a table
+typedef struct {
+	uint64_t *pairs;
+	size_t n;
+	size_t capacity;
+} pair_vector;
+
+#define RADIX_BITS 12
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+static uint8_t fold(uint8_t c) {
+	return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+static uint32_t trigram_at(char const *s) {
+	return (uint32_t)fold(s[0]) << 16 | (uint32_t)fold(s[1]) << 8 | fold(s[2]);
+}
+
+static int add_trigrams(pair_vector *v, char const *s, uint32_t id) {
+	size_t length;
+	size_t i;
+	uint64_t *p;
+
+	if (s == NULL || (length = strlen(s)) < 3) return 1;
+	if (v->n + length - 2 > v->capacity) {
+		size_t capacity = v->capacity ? v->capacity : 1024;
+		while (capacity < v->n + length - 2) capacity *= 2;
+		if ((p = realloc(v->pairs, capacity * sizeof(uint64_t))) == NULL) {
+			return 0;
+		}
+		v->pairs = p;
+		v->capacity = capacity;
+	}
+	for (i = 0; i + 2 < length; i++) {
+		v->pairs[v->n++] = (uint64_t)trigram_at(s + i) << 32 | id;
+	}
+	return 1;
+}
+
+// Build a table from pairs collected in increasing id order. A stable
+// radix sort on the trigram keeps the ids of each trigram sorted.
+static int table_build(posting_table *t, pair_vector *v) {
+	uint64_t *tmp;
+	uint64_t *src = v->pairs;
+	uint64_t *dst;
+	uint32_t *count;
+	uint32_t sum;
+	uint32_t tri;
+	uint32_t last_tri = 0;
+	size_t i;
+	size_t n;
+	int shift;
+
+	t->trigrams = NULL;
+	t->offsets = NULL;
+	t->postings = NULL;
+	t->n_trigrams = 0;
+
+	if ((tmp = malloc((v->n + 1) * sizeof(uint64_t))) == NULL) return 0;
+	if ((count = malloc(RADIX_SIZE * sizeof(uint32_t))) == NULL) {
+		free(tmp);
+		return 0;
+	}
+	dst = tmp;
+	for (shift = 32; shift < 56; shift += RADIX_BITS) {
+		memset(count, 0, RADIX_SIZE * sizeof(uint32_t));
+		for (i = 0; i < v->n; i++) {
+			count[(src[i] >> shift) & (RADIX_SIZE - 1)]++;
+		}
+		for (i = 0, sum = 0; i < RADIX_SIZE; i++) {
+			uint32_t c = count[i];
+			count[i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < v->n; i++) {
+			dst[count[(src[i] >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+		}
+		dst = src;
+		src = src == v->pairs ? tmp : v->pairs;
+	}
+	// two passes, the sorted pairs are back in v->pairs
+	free(count);
+	free(tmp);
+
+	// drop duplicate pairs and count the distinct trigrams
+	for (i = 0, n = 0; i < v->n; i++) {
+		if (n == 0 || src[i] != src[n - 1]) {
+			if (n == 0 || (src[i] >> 32) != (src[n - 1] >> 32)) t->n_trigrams++;
+			src[n++] = src[i];
+		}
+	}
+	v->n = n;
+
+	t->trigrams = malloc((t->n_trigrams + 1) * sizeof(uint32_t));
+	t->offsets = malloc((t->n_trigrams + 1) * sizeof(uint32_t));
+	t->postings = malloc((n + 1) * sizeof(uint32_t));
+	if (t->trigrams == NULL || t->offsets == NULL || t->postings == NULL) {
+		return 0;
+	}
+	t->n_trigrams = 0;
+	for (i = 0; i < n; i++) {
+		tri = (uint32_t)(src[i] >> 32);
+		if (i == 0 || tri != last_tri) {
+			t->trigrams[t->n_trigrams] = tri;
+			t->offsets[t->n_trigrams++] = (uint32_t)i;
+			last_tri = tri;
+		}
+		t->postings[i] = (uint32_t)src[i];
+	}
+	t->offsets[t->n_trigrams] = (uint32_t)n;
+	return 1;
+}
+
+static void table_free(posting_table *t) {
+	free(t->trigrams);
+	free(t->offsets);
+	free(t->postings);
+}
+
+// find the posting list of a trigram; returns its length
+static size_t table_lookup(posting_table const *t, uint32_t tri,
+		uint32_t const **list) {
+	size_t lo = 0;
+	size_t hi = t->n_trigrams;
+	size_t mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (t->trigrams[mid] < tri) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo == t->n_trigrams || t->trigrams[lo] != tri) return 0;
+	*list = t->postings + t->offsets[lo];
+	return t->offsets[lo + 1] - t->offsets[lo];
+}
+
+static int list_contains(uint32_t const *list, size_t n, uint32_t id) {
+	size_t lo = 0;
+	size_t hi = n;
+	size_t mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (list[mid] < id) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo < n && list[lo] == id;
+}
+
+// Collect the ids that contain every trigram of the pattern into out.
+// Patterns shorter than a trigram cannot be narrowed down and yield all
+// n ids.
+static size_t candidates(posting_table const *t, char const *pattern,
+		size_t length, size_t n, uint32_t *out) {
+	uint32_t const *shortest = NULL;
+	uint32_t const *list;
+	size_t n_shortest = 0;
+	size_t n_list;
+	size_t n_out;
+	size_t n_kept;
+	size_t i;
+	size_t j;
+
+	if (length < 3) {
+		for (i = 0; i < n; i++) out[i] = (uint32_t)i;
+		return n;
+	}
+
+	// start from the shortest posting list
+	for (i = 0; i + 2 < length; i++) {
+		n_list = table_lookup(t, trigram_at(pattern + i), &list);
+		if (n_list == 0) return 0;
+		if (shortest == NULL || n_list < n_shortest) {
+			shortest = list;
+			n_shortest = n_list;
+		}
+	}
+	memcpy(out, shortest, n_shortest * sizeof(uint32_t));
+	n_out = n_shortest;
+
+	for (i = 0; i + 2 < length && n_out > 0; i++) {
+		n_list = table_lookup(t, trigram_at(pattern + i), &list);
+		if (list == shortest) continue;
+		for (j = 0, n_kept = 0; j < n_out; j++) {
+			if (list_contains(list, n_list, out[j])) out[n_kept++] = out[j];
+		}
+		n_out = n_kept;
+	}
+	return n_out;
+}
+
+static int build(cx9r_trigram_index *idx, cx9r_key_tree *kt) {
+	pair_vector titles = {NULL, 0, 0};
+	pair_vector texts = {NULL, 0, 0};
+	pair_vector names = {NULL, 0, 0};
+	cx9r_kt_iter it;
+	cx9r_kt_field *f;
+	uint32_t *depth = NULL;
+	uint32_t *open = NULL;
+	size_t n_open = 0;
+	int ok = 0;
+	int event;
+
+	// count the nodes first so that the arrays are allocated once
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_FIELDS);
+	while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		if (event == CX9R_KT_ITER_GROUP) idx->n_groups++;
+		else if (event == CX9R_KT_ITER_ENTRY) idx->n_entries++;
+		else if (it.field->protected && it.field->value != NULL) idx->n_protected++;
+	}
+	if (idx->n_entries > UINT32_MAX || idx->n_groups > UINT32_MAX) return 0;
+
+	idx->entries = malloc((idx->n_entries + 1) * sizeof(cx9r_kt_entry*));
+	idx->groups = malloc(idx->n_groups * sizeof(cx9r_kt_group*));
+	idx->group_first = malloc(idx->n_groups * sizeof(uint32_t));
+	idx->group_end = malloc(idx->n_groups * sizeof(uint32_t));
+	idx->protected_values = malloc((idx->n_protected + 1) * sizeof(protected_value));
+	idx->scratch = malloc((idx->n_entries > idx->n_groups ? idx->n_entries
+			: idx->n_groups) * sizeof(uint32_t));
+	depth = malloc(idx->n_groups * sizeof(uint32_t));
+	open = malloc(idx->n_groups * sizeof(uint32_t));
+	if (idx->entries == NULL || idx->groups == NULL || idx->group_first == NULL
+			|| idx->group_end == NULL || idx->protected_values == NULL
+			|| idx->scratch == NULL || depth == NULL || open == NULL) {
+		goto cleanup;
+	}
+
+	idx->n_entries = 0;
+	idx->n_groups = 0;
+	idx->n_protected = 0;
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_ENTRIES);
+	while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		if (event == CX9R_KT_ITER_GROUP) {
+			// close the groups whose subtree ends here
+			while (n_open > 0 && depth[open[n_open - 1]] >= (uint32_t)it.depth) {
+				idx->group_end[open[--n_open]] = (uint32_t)idx->n_entries;
+			}
+			depth[idx->n_groups] = (uint32_t)it.depth;
+			idx->group_first[idx->n_groups] = (uint32_t)idx->n_entries;
+			idx->groups[idx->n_groups] = it.group;
+			if (!add_trigrams(&names, it.group->name, (uint32_t)idx->n_groups)) {
+				goto cleanup;
+			}
+			open[n_open++] = (uint32_t)idx->n_groups++;
+			continue;
+		}
+		idx->entries[idx->n_entries] = it.entry;
+		if (!add_trigrams(&titles, it.entry->name, (uint32_t)idx->n_entries)
+				|| !add_trigrams(&texts, it.entry->name, (uint32_t)idx->n_entries)) {
+			goto cleanup;
+		}
+		for (f = it.entry->fields; f != NULL; f = f->next) {
+			if (f->value == NULL) continue;
+			if (f->protected) {
+				idx->protected_values[idx->n_protected].entry = (uint32_t)idx->n_entries;
+				idx->protected_values[idx->n_protected++].value = f->value;
+			}
+			else if (!add_trigrams(&texts, f->value, (uint32_t)idx->n_entries)) {
+				goto cleanup;
+			}
+		}
+		idx->n_entries++;
+	}
+	while (n_open > 0) {
+		idx->group_end[open[--n_open]] = (uint32_t)idx->n_entries;
+	}
+
+	ok = table_build(&idx->titles, &titles) && table_build(&idx->texts, &texts)
+			&& table_build(&idx->names, &names);
+
+cleanup:
+
+	free(titles.pairs);
+	free(texts.pairs);
+	free(names.pairs);
+	free(depth);
+	free(open);
+	return ok;
+}
+
+cx9r_trigram_index *cx9r_trigram_index_build(cx9r_key_tree *kt) {
+	cx9r_trigram_index *idx;
+
+	if ((idx = calloc(1, sizeof(cx9r_trigram_index))) == NULL) {
+		return NULL;
+	}
+	idx->n_threads = 1;
+	if (!build(idx, kt)) {
+		cx9r_trigram_index_free(idx);
+		return NULL;
+	}
+	return idx;
+}
+
+void cx9r_trigram_index_free(cx9r_trigram_index *idx) {
+	if (idx == NULL) return;
+	free(idx->entries);
+	free(idx->groups);
+	free(idx->group_first);
+	free(idx->group_end);
+	free(idx->protected_values);
+	free(idx->scratch);
+	table_free(&idx->titles);
+	table_free(&idx->texts);
+	table_free(&idx->names);
+	free(idx);
+}
+
+size_t cx9r_trigram_index_entry_count(cx9r_trigram_index const *idx) {
+	return idx->n_entries;
+}
+
+void cx9r_trigram_index_set_threads(cx9r_trigram_index *idx, int n_threads) {
+	idx->n_threads = n_threads > 0 ? n_threads : 1;
+}
+
+cx9r_kt_entry *cx9r_trigram_index_get_entry(cx9r_trigram_index const *idx,
+		size_t i) {
+	return i < idx->n_entries ? idx->entries[i] : NULL;
+}
+
+#define SET_BIT(m, i) ((m)[(i) / 64] |= (uint64_t)1 << ((i) % 64))
+
+// verification of the candidate entries and scan of the protected values,
+// shared by the threads of a search
+typedef struct {
+	cx9r_trigram_index const *idx;
+	cx9r_substr const *pattern;
+	int title_only;
+	size_t n_candidates;
+	size_t n_work;	// candidates, followed by the protected values
+	size_t next;	// first item not yet taken by a thread
+	uint64_t *matches;
+} search_job;
+
+// check the unprotected text of a candidate entry
+static int entry_contains(cx9r_kt_entry const *e, cx9r_substr const *pattern,
+		int title_only) {
+	cx9r_kt_field const *f;
+
+	if (cx9r_substr_contains(pattern, e->name)) return 1;
+	if (title_only) return 0;
+	for (f = e->fields; f != NULL; f = f->next) {
+		if (!f->protected && cx9r_substr_contains(pattern, f->value)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// take chunks of work until none are left; threads that finish early
+// simply take more chunks
+static void *search_worker(void *arg) {
+	search_job *job = arg;
+	cx9r_trigram_index const *idx = job->idx;
+	size_t start;
+	size_t end;
+	size_t i;
+	uint32_t entry;
+	int match;
+
+	while ((start = __atomic_fetch_add(&job->next, PARALLEL_CHUNK,
+			__ATOMIC_RELAXED)) < job->n_work) {
+		end = start + PARALLEL_CHUNK < job->n_work ? start + PARALLEL_CHUNK
+				: job->n_work;
+		for (i = start; i < end; i++) {
+			if (i < job->n_candidates) {
+				entry = idx->scratch[i];
+				match = entry_contains(idx->entries[entry], job->pattern,
+						job->title_only);
+			}
+			else {
+				entry = idx->protected_values[i - job->n_candidates].entry;
+				match = cx9r_substr_contains(job->pattern,
+						idx->protected_values[i - job->n_candidates].value);
+			}
+			if (match) {
+				__atomic_fetch_or(&job->matches[entry / 64],
+						(uint64_t)1 << (entry % 64), __ATOMIC_RELAXED);
+			}
+		}
+	}
+	return NULL;
+}
+
+// run a job on up to n_threads threads, including the calling one
+static void run_job(search_job *job, int n_threads) {
+	pthread_t threads[n_threads];
+	int started = 0;
+
+	if (job->n_work >= PARALLEL_MIN_WORK) {
+		// if a thread cannot be created, the others do its share
+		while (started < n_threads - 1 && pthread_create(&threads[started],
+				NULL, search_worker, job) == 0) {
+			started++;
+		}
+	}
+	search_worker(job);
+	while (started > 0) {
+		pthread_join(threads[--started], NULL);
+	}
+}
+
+size_t cx9r_trigram_index_search(cx9r_trigram_index *idx,
+		cx9r_substr const *pattern, int flags, uint64_t *matches) {
+	int title_only = flags & CX9R_TRIGRAM_TITLE_ONLY;
+	search_job job;
+	size_t n;
+	size_t i;
+	size_t count = 0;
+	uint32_t j;
+	cx9r_kt_group const *g;
+
+	memset(matches, 0, CX9R_BITMAP_WORDS(idx->n_entries) * sizeof(uint64_t));
+
+	if (!title_only) {
+		// a matching group name selects all entries below the group
+		n = candidates(&idx->names, pattern->pattern, pattern->length,
+				idx->n_groups, idx->scratch);
+		for (i = 0; i < n; i++) {
+			g = idx->groups[idx->scratch[i]];
+			if (!cx9r_substr_contains(pattern, g->name)) continue;
+			for (j = idx->group_first[idx->scratch[i]];
+					j < idx->group_end[idx->scratch[i]]; j++) {
+				SET_BIT(matches, j);
+			}
+		}
+	}
+
+	job.idx = idx;
+	job.pattern = pattern;
+	job.title_only = title_only;
+	job.n_candidates = candidates(title_only ? &idx->titles : &idx->texts,
+			pattern->pattern, pattern->length, idx->n_entries, idx->scratch);
+	job.n_work = job.n_candidates + (title_only ? 0 : idx->n_protected);
+	job.next = 0;
+	job.matches = matches;
+	run_job(&job, idx->n_threads);
+
+	for (i = 0; i < CX9R_BITMAP_WORDS(idx->n_entries); i++) {
+		count += __builtin_popcountll(matches[i]);
+	}
+	return count;
+}
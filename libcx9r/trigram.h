@@ -0,0 +1,95 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CX9R_TRIGRAM_H
+#define CX9R_TRIGRAM_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "key_tree.h"
+#include "substr.h"
+
+// only match entry titles, not group names and field values
+#define CX9R_TRIGRAM_TITLE_ONLY 1
+
+// number of 64-bit words in a bitmap of n entries
+#define CX9R_BITMAP_WORDS(n) (((n) + 63) / 64)
+
+typedef struct cx9r_trigram_index cx9r_trigram_index;
+
+/**
+ * Build a substring search index over a key tree. Entry titles, group
+ * names and field values are indexed by their (ASCII case folded)
+ * trigrams; protected values are kept out of the index and scanned
+ * when searching. Entries are numbered in the order of a
+ * cx9r_kt_iter over the root. The tree must not change while the
+ * index is in use.
+ * @param kt key tree
+ * @return index, or NULL if allocation failed
+ */
+cx9r_trigram_index *cx9r_trigram_index_build(cx9r_key_tree *kt);
+
+/**
+ * Free an index.
+ * @param idx index
+ */
+void cx9r_trigram_index_free(cx9r_trigram_index *idx);
+
+/**
+ * Get the number of entries covered by an index.
+ * @param idx index
+ * @return number of entries
+ */
+size_t cx9r_trigram_index_entry_count(cx9r_trigram_index const *idx);
+
+/**
+ * Set the number of threads a search may use; searches with little
+ * work always run on the calling thread only.
+ * @param idx index
+ * @param n_threads number of threads, 1 by default
+ */
+void cx9r_trigram_index_set_threads(cx9r_trigram_index *idx, int n_threads);
+
+/**
+ * Get an entry by its number.
+ * @param idx index
+ * @param i entry number
+ * @return entry, or NULL if i is out of range
+ */
+cx9r_kt_entry *cx9r_trigram_index_get_entry(cx9r_trigram_index const *idx,
+		size_t i);
+
+/**
+ * Find the entries containing a pattern, with the same result as testing
+ * every entry with cx9r_substr_contains(): in the title and, unless
+ * CX9R_TRIGRAM_TITLE_ONLY is given, in the name of any enclosing group
+ * or in any field value. Not reentrant, the index holds the scratch
+ * space of a search. Candidates are verified in parallel when more than
+ * one thread is allowed.
+ * @param idx index
+ * @param pattern compiled pattern to search for
+ * @param flags CX9R_TRIGRAM_TITLE_ONLY or 0
+ * @param matches bitmap of CX9R_BITMAP_WORDS(number of entries) words,
+ * receives a set bit for every matching entry
+ * @return number of matching entries
+ */
+size_t cx9r_trigram_index_search(cx9r_trigram_index *idx,
+		cx9r_substr const *pattern, int flags, uint64_t *matches);
+
+#endif
@@ -0,0 +1,218 @@
+/* Cryptkeyper is
+ *
+ *     Copyright (C) 2013 Jonas Hagmar (jonas.hagmar@gmail.com)
+ *
+ * This file is part of cryptkeyper.
+ *
+ * Cryptkeyper is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ * Cryptkeyper is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with cryptkeyper. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trigram.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#define N_GROUPS 40
+#define N_ENTRIES 5000
+#define N_QUERIES 500
+#define WORD_LENGTH 8
+
+#define IC CX9R_SUBSTR_IGNORE_CASE
+
+static uint32_t seed = 1;
+
+// small deterministic generator, so that failures can be reproduced
+static uint32_t next_random() {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+// random text over a small alphabet, so that trigrams repeat
+static void random_text(char *s, size_t length) {
+	static char const alphabet[] = "abcABC.-";
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		s[i] = alphabet[next_random() % (sizeof(alphabet) - 1)];
+	}
+	s[length] = 0;
+}
+
+// naive substring test, optionally ignoring the case of ASCII letters
+static int contains(char const *s, char const *pattern, int ignore_case) {
+	size_t i;
+
+	if (s == NULL) return 0;
+	for (; ; s++) {
+		for (i = 0; pattern[i] != 0; i++) {
+			if (ignore_case ? tolower((unsigned char)s[i])
+					!= tolower((unsigned char)pattern[i]) : s[i] != pattern[i]) break;
+		}
+		if (pattern[i] == 0) return 1;
+		if (*s == 0) return 0;
+	}
+}
+
+// reference: test the entry the way a full scan does
+static int scan(cx9r_kt_group *g, cx9r_kt_entry *e, char const *pattern,
+		int title_only, int ignore_case) {
+	cx9r_kt_field *f;
+
+	if (contains(cx9r_kt_entry_get_name(e), pattern, ignore_case)) return 1;
+	if (title_only) return 0;
+	for (; g != NULL; g = cx9r_kt_group_get_parent(g)) {
+		if (contains(cx9r_kt_group_get_name(g), pattern, ignore_case)) return 1;
+	}
+	for (f = cx9r_kt_entry_get_fields(e); f != NULL; f = cx9r_kt_field_get_next(f)) {
+		if (contains(cx9r_kt_field_get_value(f), pattern, ignore_case)) return 1;
+	}
+	return 0;
+}
+
+// compare the index with a full scan for one pattern
+static int check(cx9r_key_tree *kt, cx9r_trigram_index *idx,
+		char const *pattern, int flags, int substr_flags, uint64_t *matches) {
+	cx9r_kt_iter it;
+	cx9r_substr s;
+	size_t n;
+	size_t i = 0;
+	size_t count = 0;
+	int match;
+
+	if (!cx9r_substr_compile(&s, pattern, substr_flags)) return 0;
+	n = cx9r_trigram_index_search(idx, &s, flags, matches);
+	cx9r_substr_free(&s);
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_ENTRIES);
+	while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) {
+		if (it.event != CX9R_KT_ITER_ENTRY) continue;
+		if (cx9r_trigram_index_get_entry(idx, i) != it.entry) return 0;
+		match = scan(it.group, it.entry, pattern, flags & CX9R_TRIGRAM_TITLE_ONLY,
+				substr_flags & CX9R_SUBSTR_IGNORE_CASE);
+		if (match != (int)((matches[i / 64] >> (i % 64)) & 1)) return 0;
+		count += match;
+		i++;
+	}
+	return i == cx9r_trigram_index_entry_count(idx) && count == n;
+}
+
+static size_t count_bits(uint64_t const *matches) {
+	size_t count = 0;
+	size_t i;
+
+	for (i = 0; i < N_ENTRIES; i++) {
+		count += (matches[i / 64] >> (i % 64)) & 1;
+	}
+	return count;
+}
+
+int main() {
+
+	cx9r_key_tree *kt;
+	cx9r_trigram_index *idx = NULL;
+	cx9r_kt_group *groups[N_GROUPS];
+	cx9r_kt_group *g;
+	cx9r_kt_entry *e;
+	cx9r_kt_field *f;
+	uint64_t matches[CX9R_BITMAP_WORDS(N_ENTRIES)];
+	char text[4 * WORD_LENGTH + 1];
+	int i;
+
+	printf("building key tree...");
+	if ((kt = cx9r_key_tree_create()) == NULL) goto bail;
+	groups[0] = cx9r_key_tree_get_root(kt);
+	if (cx9r_kt_group_set_zname(groups[0], "Root") == NULL) goto dealloc_tree;
+	for (i = 1; i < N_GROUPS; i++) {
+		g = cx9r_kt_group_add_child(groups[next_random() % i]);
+		if (g == NULL) goto dealloc_tree;
+		random_text(text, WORD_LENGTH);
+		if (cx9r_kt_group_set_zname(g, text) == NULL) goto dealloc_tree;
+		groups[i] = g;
+	}
+	for (i = 0; i < N_ENTRIES; i++) {
+		e = cx9r_kt_group_add_entry(groups[next_random() % N_GROUPS]);
+		if (e == NULL) goto dealloc_tree;
+		// leave some titles unset
+		if (i % 10 != 0) {
+			random_text(text, WORD_LENGTH);
+			if (cx9r_kt_entry_set_zname(e, text) == NULL) goto dealloc_tree;
+		}
+		if ((f = cx9r_kt_entry_add_field(e)) == NULL) goto dealloc_tree;
+		if (cx9r_kt_field_set_zname(f, "UserName") == NULL) goto dealloc_tree;
+		random_text(text, next_random() % (4 * WORD_LENGTH));
+		if (cx9r_kt_field_set_zvalue(f, text) == NULL) goto dealloc_tree;
+		if ((f = cx9r_kt_entry_add_field(e)) == NULL) goto dealloc_tree;
+		if (cx9r_kt_field_set_zname(f, "Password") == NULL) goto dealloc_tree;
+		random_text(text, WORD_LENGTH);
+		if (cx9r_kt_field_set_zvalue(f, text) == NULL) goto dealloc_tree;
+		cx9r_kt_field_set_protected(f, 1);
+	}
+	printf("ok\n");
+
+	printf("building index...");
+	if ((idx = cx9r_trigram_index_build(kt)) == NULL) goto dealloc_tree;
+	if (cx9r_trigram_index_entry_count(idx) != N_ENTRIES) goto dealloc_index;
+	if (cx9r_trigram_index_get_entry(idx, N_ENTRIES) != NULL) goto dealloc_index;
+	printf("ok\n");
+
+	printf("fixed patterns...");
+	if (!check(kt, idx, "", 0, 0, matches)) goto dealloc_index;
+	if (!check(kt, idx, "", CX9R_TRIGRAM_TITLE_ONLY, 0, matches)) goto dealloc_index;
+	if (!check(kt, idx, "a", 0, 0, matches)) goto dealloc_index;
+	if (!check(kt, idx, "Ro", 0, 0, matches)) goto dealloc_index;
+	// every entry is below the root group
+	if (!check(kt, idx, "Root", 0, 0, matches)) goto dealloc_index;
+	if (count_bits(matches) != N_ENTRIES) goto dealloc_index;
+	if (!check(kt, idx, "Root", CX9R_TRIGRAM_TITLE_ONLY, 0, matches))
+		goto dealloc_index;
+	if (count_bits(matches) != 0) goto dealloc_index;
+	// the index folds case, the match only if asked to
+	if (!check(kt, idx, "ROOT", 0, 0, matches)) goto dealloc_index;
+	if (count_bits(matches) != 0) goto dealloc_index;
+	if (!check(kt, idx, "ROOT", 0, IC, matches)) goto dealloc_index;
+	if (count_bits(matches) != N_ENTRIES) goto dealloc_index;
+	if (!check(kt, idx, "xyz", 0, IC, matches)) goto dealloc_index;
+	if (count_bits(matches) != 0) goto dealloc_index;
+	printf("ok\n");
+
+	printf("random patterns...");
+	for (i = 0; i < N_QUERIES; i++) {
+		// short patterns give enough candidates for a parallel search
+		cx9r_trigram_index_set_threads(idx, i % 2 ? 4 : 1);
+		random_text(text, 1 + next_random() % 6);
+		if (!check(kt, idx, text, 0, 0, matches)) goto dealloc_index;
+		if (!check(kt, idx, text, CX9R_TRIGRAM_TITLE_ONLY, 0, matches))
+			goto dealloc_index;
+		if (!check(kt, idx, text, 0, IC, matches)) goto dealloc_index;
+		if (!check(kt, idx, text, CX9R_TRIGRAM_TITLE_ONLY, IC, matches))
+			goto dealloc_index;
+	}
+	printf("ok\n");
+
+	cx9r_trigram_index_free(idx);
+	cx9r_key_tree_free(kt);
+
+	return 0;
+
+dealloc_index:
+
+	cx9r_trigram_index_free(idx);
+
+dealloc_tree:
+
+	cx9r_key_tree_free(kt);
+
+bail:
+
+	printf("fail\n");
+	return 1;
+}
@@ -0,0 +1,172 @@
+// agent.c
+
+#define _GNU_SOURCE  // for struct ucred
+#include <stdio.h>  // for snprintf
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "agent.h"
+
+// Set when the agent is to lock: wipe the database and quit
+static volatile sig_atomic_t locked = 0;
+
+static void lock(int sig) {
+	(void)sig;
+	locked = 1;
+}
+
+// The socket lives in $XDG_RUNTIME_DIR, or else in a directory of the
+// user's own in /tmp; NULL if that directory can't be made safe
+char *agent_socket_path(void) {
+	size_t size = sizeof(((struct sockaddr_un *)0)->sun_path);
+	char *dir = getenv("XDG_RUNTIME_DIR"), *path = malloc(size);
+	struct stat st;
+	if (path == NULL) return NULL;
+	if (dir != NULL && *dir == '/') {
+		if ((size_t)snprintf(path, size, "%s/kdbxviewer-agent", dir) < size)
+			return path;
+	}
+	else {
+		snprintf(path, size, "/tmp/kdbxviewer-%u", (unsigned)getuid());
+		if ((mkdir(path, 0700) == 0 || errno == EEXIST)
+				&& lstat(path, &st) == 0 && S_ISDIR(st.st_mode)
+				&& st.st_uid == getuid() && (st.st_mode & 077) == 0) {
+			strcat(path, "/agent");
+			return path;
+		}
+	}
+	free(path);
+	return NULL;
+}
+
+static int agent_connect(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+	close(fd);
+	return -1;
+}
+
+// Whether the other end of a connection runs as the same user
+static int same_user(int fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0
+		&& cred.uid == geteuid();
+}
+
+// Returns the listening socket, -1 on errors, -2 if an agent is running
+int agent_listen(const char *path) {
+	struct sockaddr_un addr;
+	mode_t mask;
+	int fd;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if ((fd = agent_connect(path)) >= 0) {
+		close(fd);
+		return -2;
+	}
+	// Not answering, so left behind
+	unlink(path);
+	strcpy(addr.sun_path, path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+	mask = umask(077);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+			|| listen(fd, 16) != 0) {
+		umask(mask);
+		close(fd);
+		return -1;
+	}
+	umask(mask);
+	return fd;
+}
+
+// Serve connections one at a time until no client came for timeout
+// seconds (0 for no limit), or until SIGUSR1, SIGHUP, SIGINT or SIGTERM
+// asks to lock; the socket is removed before returning
+int agent_serve(int fd, const char *path, int timeout, agent_handler serve,
+		void *data) {
+	struct sigaction sa;
+	struct pollfd p = {fd, POLLIN, 0};
+	struct timeval tv = {30, 0};
+	int conn, n;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = lock;
+	sigaction(SIGUSR1, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	// A client that goes away must not take the agent with it
+	signal(SIGPIPE, SIG_IGN);
+	while (!locked) {
+		if ((n = poll(&p, 1, timeout > 0 ? timeout * 1000 : -1)) == 0) break;
+		if (n < 0 || (conn = accept(fd, NULL, NULL)) < 0) continue;
+		// Nor may a client that says nothing block it for long
+		setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		if (same_user(conn)) serve(conn, data);
+		else close(conn);
+	}
+	close(fd);
+	unlink(path);
+	return 0;
+}
+
+// Send the query, or else the queries read from stdin, to the agent and
+// copy its answers to stdout; returns -1 if no agent answers
+int agent_ask(const char *path, const char *query) {
+	struct pollfd p[2];
+	char buf[4096];
+	ssize_t n;
+	int fd = agent_connect(path), done = 0;
+	if (fd < 0) return -1;
+	if (!same_user(fd)) {
+		close(fd);
+		return -1;
+	}
+	p[0].fd = STDIN_FILENO;
+	p[1].fd = fd;
+	p[0].events = p[1].events = POLLIN;
+	if (query != NULL) {
+		// A query can't hold a newline, so it ends at the first one
+		if (write(fd, query, strcspn(query, "\n")) < 0 || write(fd, "\n", 1) < 0)
+			done = 1;
+		p[0].fd = -1;
+		shutdown(fd, SHUT_WR);
+	}
+	while (!done) {
+		if (poll(p, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (p[0].revents) {
+			if ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
+				if (write(fd, buf, n) != n) break;
+			}
+			else {
+				p[0].fd = -1;
+				shutdown(fd, SHUT_WR);
+			}
+		}
+		if (p[1].revents) {
+			if ((n = read(fd, buf, sizeof(buf))) <= 0) break;
+			if (write(STDOUT_FILENO, buf, n) != n) break;
+		}
+	}
+	close(fd);
+	return 0;
+}
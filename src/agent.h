@@ -0,0 +1,10 @@
+// agent.h
+
+// Handles one client connection of the agent
+typedef int (*agent_handler)(int conn, void *data);
+
+char *agent_socket_path(void);
+int agent_listen(const char *path);
+int agent_serve(int fd, const char *path, int timeout, agent_handler serve,
+	void *data);
+int agent_ask(const char *path, const char *query);
@@ -9,24 +9,25 @@
 
 #include "helper.h"
 
-const char *getfield(cx9r_kt_entry *e, char *name) {
-	cx9r_kt_field *f = cx9r_kt_entry_get_fields(e);
-	while(f != NULL) {
-		if (strcmp(cx9r_kt_field_get_name(f), name) == 0)
-			return cx9r_kt_field_get_value(f) ? cx9r_kt_field_get_value(f) : "";
-		f = cx9r_kt_field_get_next(f);
-	}
-	return "";
+// Standard fields are looked up directly, others by their interned id
+const char *getfield(cx9r_kt_entry *e, int id) {
+	const char *value = cx9r_kt_entry_get_value(e, id);
+	return value ? value : "";
 }
 
-// Double the doublequotes for CSV
-char *dq(const char *field) {
-	// Needs to be freed by the caller
-	char *dqfield = malloc(2*strlen(field)), *pointer = dqfield;
-	while (*field) {
-		*pointer = *(field++);
-		if (*(pointer++) == '"') *(pointer++) = '"';
+// Split a comma separated list into a NULL terminated array of names
+char **split_list(const char *list) {
+	// Needs to be freed by the caller; the names are stored behind the array
+	size_t n = 2, len = strlen(list) + 1;
+	const char *p;
+	char **names, *name;
+	for (p = list; *p; p++) if (*p == ',') n++;
+	if ((names = malloc(n * sizeof(char *) + len)) == NULL) return NULL;
+	name = memcpy(names + n, list, len);
+	for (n = 0; name != NULL; n++) {
+		names[n] = name;
+		if ((name = strchr(name, ',')) != NULL) *name++ = 0;
 	}
-	*pointer = 0;
-	return dqfield;
+	names[n] = NULL;
+	return names;
 }
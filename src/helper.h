@@ -2,5 +2,5 @@
 
 #include <cx9r.h>
 
-const char* getfield(cx9r_kt_entry* e, char* name);
-char* dq(const char* field);
+const char* getfield(cx9r_kt_entry* e, int id);
+char** split_list(const char* list);
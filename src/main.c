@@ -5,17 +5,46 @@
 
 #include <stdio.h>  // for puts/(f)printf/fopen/getline
 #include <stdlib.h>  // for exit
-#include <unistd.h>  // for getopt
+#include <unistd.h>
+#include <getopt.h>  // for getopt_long
 #include <string.h>
+#include <strings.h>  // for strcasecmp
+#include <limits.h>  // for PATH_MAX
+#include <sys/stat.h>  // for mkdir
+#include <pthread.h>
+#include <fcntl.h>  // for open
+#include <errno.h>
+#include <sys/mman.h>  // for mlockall
 
 #include <cx9r.h>
 #include <key_tree.h>
+#include <trigram.h>
+#include <query.h>
+#include <regex_search.h>
+#include <mem_stats.h>
+#include <sha256.h>
 #include "tui.h"
 #include "helper.h"
+#include "output.h"
+#include "agent.h"
 
 char *search = NULL;
 bool searchall = FALSE;
+bool query = FALSE;
+bool regex = FALSE;
+bool uuid = FALSE;
+bool cache = FALSE;
+bool use_agent = FALSE;
+int agent_timeout = 600;
+bool ignorecase = FALSE;
 int unmask = 0;
+uint64_t *selected = NULL;
+#define DEFAULT_COLUMNS "Group,Title,Username,Password,URL,Notes"
+char *columns = NULL;
+char *fields = NULL;
+int *shown_fields = NULL;  // ids of the fields output, if fields is set
+size_t n_shown_fields = 0;
+output out;
 
 #define BGREEN "\033[1m\033[92m"
 #define BRED "\033[1m\033[91m"
@@ -39,13 +68,24 @@ void print_help(char *self, char *configfile) {
 	printf("%s %s - View KeePass2 .kdbx databases in various formats and ways\n",
 			self, VERSION);
 	puts("Usage:  ");
-	printf("%s [-i|-t|-x|-c|-h|-V] [-A] [-p PW] [-u] [[-s|-S] STR] [-d KDBX]\n",
+	printf("%s [-i|-t|-x|-c|-j|-J|--batch|--agent|--mem-report|-h|-V] [-A] [-p PW] [-u] [-I] [--use-agent] [--agent-timeout SECS] [-f FIELDS] [--columns LIST] [--cache] [[-s|-S] STR|-q QUERY|-r REGEX|--uuid UUID] [-d KDBX]...\n",
 			self);
 	puts("Commands:");
 	puts("  -i          Interactive viewing (default if no search is used)");
 	puts("  -t          Output as Tree (default if search is used)");
 	puts("  -x          Output as XML");
 	puts("  -c          Output as CSV");
+	puts("  -j          Output as JSON");
+	puts("  -J          Output as JSON lines, one entry per line");
+	puts("  --batch     Answer queries from stdin, one per line (or NUL ended):");
+	puts("                a UUID, a query like for -q when the word before the");
+	puts("                first colon is group or a field name, or else a string");
+	puts("                like for -s; writes one JSON line");
+	puts("                per query with the entries found, after each query");
+	puts("  --agent     Answer queries like --batch does for --use-agent, from");
+	puts("                the background, until idle for --agent-timeout");
+	puts("                or until sent SIGUSR1");
+	puts("  --mem-report  Report the memory used to load the database");
 	puts("  -h          Display this Help text");
 	puts("  -V          Display Version");
 	puts("Options:");
@@ -53,96 +93,910 @@ void print_help(char *self, char *configfile) {
 	puts("  -p PW       Decrypt file KDBX using PW  (Never use on shared");
 	puts("                computers as PW can be seen in the process list!)");
 	puts("  -u          Display Password fields Unmasked");
+	puts("  -f FIELDS   Output only the comma separated FIELDS, like:");
+	puts("                UserName,Password (tree, CSV and JSON output)");
+	puts("  --use-agent Ask the running --agent instead of opening the database,");
+	puts("                for STR or with --batch for the queries from stdin");
+	puts("                (answered like --batch does, so with JSON lines)");
+	puts("  --agent-timeout SECS  Stop the agent after SECS idle seconds, 0 for");
+	puts("                never, default 600");
+	puts("  --columns LIST  Output the comma separated LIST of columns as CSV:");
+	puts("                Group, Path (of the group) or field names, default:");
+	puts("                Group,Title,Username,Password,URL,Notes");
+	puts("  --cache     Keep an encrypted snapshot of the opened database, so");
+	puts("                that it loads faster while the file is unchanged");
 	puts("  [-s] STR    Select only entries with STR in the Title");
 	puts("  -S STR      Select only entries with STR in any field");
+	puts("  -q QUERY    Select only entries matching QUERY, like:");
+	puts("                group:Prod AND url:*.corp NOT title:old");
+	puts("  -r REGEX    Select only entries with a match of the extended");
+	puts("                regular expression REGEX in the Title or any field");
+	puts("  --uuid UUID Select only the entry with UUID (32 hex digits, dashes");
+	puts("                allowed), or all entries of the group with UUID");
+	puts("  -I          Ignore case of ASCII letters when selecting");
 	puts("  -d KDBX     Use KDBX as the path/filename for the Database");
+	puts("                (repeat to open several Databases at once, with the same");
+	puts("                password, each shown as a top-level group named after");
+	puts("                its file)");
 	printf("The configfile %s is used for storing KDBX database filenames.\n",
 			configfile);
 	puts("Website:      https://gitlab.com/pepa65/kdbxviewer");
 }
 
-int check_filter(cx9r_kt_entry *e, cx9r_kt_group *g) {
+// Select the entries for which match() holds, numbered in tree order
+uint64_t *select_matching(cx9r_key_tree *kt,
+		int (*match)(void *, cx9r_kt_group *, cx9r_kt_entry *), void *data) {
+	size_t n = 0;
+	cx9r_kt_iter it;
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_ENTRIES);
+	while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END)
+		if (it.event == CX9R_KT_ITER_ENTRY) n++;
+	// One spare word, so that an empty database is not taken for failure
+	uint64_t *matches = calloc(CX9R_BITMAP_WORDS(n) + 1, sizeof(uint64_t));
+	if (matches == NULL) return NULL;
+	n = 0;
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_ENTRIES);
+	while (cx9r_kt_iter_next(&it) != CX9R_KT_ITER_END) {
+		if (it.event != CX9R_KT_ITER_ENTRY) continue;
+		if (match(data, it.group, it.entry))
+			matches[n / 64] |= (uint64_t)1 << (n % 64);
+		n++;
+	}
+	return matches;
+}
+
+static int query_match(void *q, cx9r_kt_group *g, cx9r_kt_entry *e) {
+	return cx9r_query_match(q, g, e);
+}
+
+uint64_t *select_query(cx9r_key_tree *kt) {
+	char const *error;
+	cx9r_query *q = cx9r_query_compile(kt, search,
+			ignorecase ? CX9R_SUBSTR_IGNORE_CASE : 0, &error);
+	if (q == NULL) {
+		if (error != NULL) fprintf(stderr, "%sInvalid query: %s\n", ERRC, error);
+		return NULL;
+	}
+	uint64_t *matches = select_matching(kt, query_match, q);
+	if (matches == NULL) fprintf(stderr, "%sOut of memory while searching\n", ERRC);
+	cx9r_query_free(q);
+	return matches;
+}
+
+static int regex_match(void *r, cx9r_kt_group *g, cx9r_kt_entry *e) {
+	cx9r_kt_field *f;
+	(void)g;
+	if (cx9r_regex_match(r, cx9r_kt_entry_get_name(e))) return 1;
+	for (f = cx9r_kt_entry_get_fields(e); f != NULL; f = cx9r_kt_field_get_next(f))
+		if (cx9r_regex_match(r, cx9r_kt_field_get_value(f))) return 1;
+	return 0;
+}
+
+// Match the title and all field values
+uint64_t *select_regex(cx9r_key_tree *kt) {
+	char error[256];
+	cx9r_regex r;
+	if (!cx9r_regex_compile(&r, search, ignorecase ? CX9R_SUBSTR_IGNORE_CASE : 0,
+			error, sizeof(error))) {
+		fprintf(stderr, "%sInvalid regular expression: %s\n", ERRC, error);
+		return NULL;
+	}
+	uint64_t *matches = select_matching(kt, regex_match, &r);
+	if (matches == NULL) fprintf(stderr, "%sOut of memory while searching\n", ERRC);
+	cx9r_regex_free(&r);
+	return matches;
+}
+
+// Built by the first search, and kept for the next ones
+cx9r_trigram_index *trigram_index = NULL;
+
+uint64_t *select_search(cx9r_key_tree *kt) {
+	cx9r_substr pattern;
+	uint64_t *matches = NULL;
+	if (!cx9r_substr_compile(&pattern, search,
+			ignorecase ? CX9R_SUBSTR_IGNORE_CASE : 0)) pattern.pattern = NULL;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (pattern.pattern != NULL && trigram_index == NULL
+			&& (trigram_index = cx9r_trigram_index_build(kt)) != NULL)
+		cx9r_trigram_index_set_threads(trigram_index, cpus > 0 ? cpus : 1);
+	if (pattern.pattern != NULL && trigram_index != NULL)
+		matches = malloc((CX9R_BITMAP_WORDS(cx9r_trigram_index_entry_count(
+				trigram_index)) + 1) * sizeof(uint64_t));
+	if (matches != NULL)
+		cx9r_trigram_index_search(trigram_index, &pattern, searchall ? 0 :
+				CX9R_TRIGRAM_TITLE_ONLY, matches);
+	else fprintf(stderr, "%sOut of memory while searching\n", ERRC);
+	cx9r_substr_free(&pattern);
+	return matches;
+}
+
+// Parse 32 hex digits, dashes in between are skipped
+static int parse_uuid(uint8_t *u, char const *s) {
+	int i, d;
+	memset(u, 0, CX9R_UUID_LENGTH);
+	for (i = 0; i < 2 * CX9R_UUID_LENGTH; s++) {
+		if (*s == '-' && i > 0) continue;
+		if (*s >= '0' && *s <= '9') d = *s - '0';
+		else if (*s >= 'a' && *s <= 'f') d = *s - 'a' + 10;
+		else if (*s >= 'A' && *s <= 'F') d = *s - 'A' + 10;
+		else return 0;
+		u[i / 2] |= d << (i % 2 ? 0 : 4);
+		i++;
+	}
+	return *s == 0;
+}
+
+typedef struct {
+	cx9r_kt_group *group;
+	cx9r_kt_entry *entry;
+} uuid_target;
+
+// The entry itself, or any entry below the group
+static int uuid_match(void *data, cx9r_kt_group *g, cx9r_kt_entry *e) {
+	uuid_target *t = data;
+	if (t->entry != NULL) return e == t->entry;
+	for (; g != NULL; g = cx9r_kt_group_get_parent(g))
+		if (g == t->group) return 1;
+	return 0;
+}
+
+uint64_t *select_uuid(cx9r_key_tree *kt) {
+	uint8_t u[CX9R_UUID_LENGTH];
+	uuid_target t;
+	if (!parse_uuid(u, search)) {
+		fprintf(stderr, "%sInvalid UUID: %s\n", ERRC, search);
+		return NULL;
+	}
+	if (!cx9r_key_tree_find_uuid(kt, u, &t.group, &t.entry)) {
+		fprintf(stderr, "%sUUID not found: %s\n", ERRC, search);
+		return NULL;
+	}
+	uint64_t *matches = select_matching(kt, uuid_match, &t);
+	if (matches == NULL) fprintf(stderr, "%sOut of memory while searching\n", ERRC);
+	return matches;
+}
+
+// Select the entries matching the search, numbered in tree order
+uint64_t *select_entries(cx9r_key_tree *kt) {
+	if (query) return select_query(kt);
+	if (regex) return select_regex(kt);
+	if (uuid) return select_uuid(kt);
+	return select_search(kt);
+}
+
+int check_filter(size_t i) {
 	if (search == NULL) return 1;
-	if (e->name != NULL && strstr(e->name, search)) return 1;
-	if (!searchall) return 0;
-	while(g != NULL) {
-		if (strstr(cx9r_kt_group_get_name(g), search)) return 1;
-		g = cx9r_kt_group_get_parent(g);
-	}
-	cx9r_kt_field *f = cx9r_kt_entry_get_fields(e);
-	while(f != NULL) {
-		const char *val = cx9r_kt_field_get_value(f);
-		if (val != NULL && strstr(val, search)) return 1;
-		f = cx9r_kt_field_get_next(f);
+	return selected[i / 64] >> (i % 64) & 1;
+}
+
+// Resolve a field name, standard field names match in any case
+static int field_id(cx9r_key_tree *kt, const char *name) {
+	int id;
+	if ((id = cx9r_key_tree_lookup_field_id(kt, name)) != CX9R_FIELD_NONE)
+		return id;
+	for (id = 0; id < CX9R_N_STD_FIELDS; id++)
+		if (strcasecmp(name, cx9r_key_tree_get_field_name(kt, id)) == 0)
+			return id;
+	return CX9R_FIELD_NONE;
+}
+
+// Look up the ids of the fields selected with -f
+int select_fields(cx9r_key_tree *kt) {
+	char **names = split_list(fields);
+	size_t i;
+	int id;
+	if (names == NULL) return -1;
+	for (i = 0; names[i] != NULL; i++);
+	if ((shown_fields = malloc(i * sizeof(int))) == NULL) {
+		free(names);
+		return -1;
 	}
+	for (i = 0; names[i] != NULL; i++)
+		if ((id = field_id(kt, names[i])) != CX9R_FIELD_NONE)
+			shown_fields[n_shown_fields++] = id;
+	free(names);
 	return 0;
 }
 
-// Print Tree
-static void indent(int n) {
-	while(n-- > 0) printf("%s|%s ", GROUP, RESET);
+static int field_shown(cx9r_kt_field *f) {
+	size_t i;
+	if (fields == NULL) return 1;
+	for (i = 0; i < n_shown_fields; i++)
+		if (shown_fields[i] == f->id) return 1;
+	return 0;
 }
-static void dump_tree_field(cx9r_kt_field *f, int depth) {
-	if (f->value != NULL) {
-		if (strcmp(f->name, "Notes") == 0) indent(depth-1);
-		else {
-			indent(depth-1);
-			printf("%s%s: \"%s", FIELD, f->name, RESET);
+
+// Formats are written one group at a time: a format function writes the
+// subtree of g, numbering its entries from *n on for check_filter(); with
+// own set it writes only the start of the output for g, up to its first
+// child group, and the caller writes the child groups and the end.
+typedef void (*format_fn)(output *o, cx9r_kt_group *g, size_t *n, int own);
+
+// Trees with fewer entries are formatted on the main thread only
+#define PARALLEL_MIN_ENTRIES 4096
+#define PARALLEL_MAX_THREADS 16
+
+typedef struct {
+	cx9r_kt_group *group;
+	size_t n;  // number of the first entry in the subtree
+	output o;
+} format_job;
+
+typedef struct {
+	format_fn fn;
+	format_job *jobs;
+	size_t n_jobs;
+	size_t next;  // next job to be taken, advanced atomically
+} format_work;
+
+static void *format_worker(void *arg) {
+	format_work *w = arg;
+	format_job *job;
+	size_t i;
+	while ((i = __sync_fetch_and_add(&w->next, 1)) < w->n_jobs) {
+		job = &w->jobs[i];
+		if (out_open(&job->o, -1) == 0) w->fn(&job->o, job->group, &job->n, 0);
+	}
+	return NULL;
+}
+
+// Format the child groups of g into their own buffers on worker threads,
+// then write the buffers in order; returns 0 when the tree is too small
+// or memory is short, and nothing was written
+static int format_parallel(format_fn fn, cx9r_kt_group *g, size_t n,
+		char const *sep) {
+	format_work w = {fn, NULL, 0, 0};
+	cx9r_kt_group *c;
+	cx9r_kt_iter it;
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN), i, started = 0;
+	size_t j;
+	int event;
+	if (n_threads < 2) return 0;
+	if (n_threads > PARALLEL_MAX_THREADS) n_threads = PARALLEL_MAX_THREADS;
+	for (c = cx9r_kt_group_get_children(g); c != NULL; c = cx9r_kt_group_get_next(c))
+		w.n_jobs++;
+	if (w.n_jobs < 2 || (w.jobs = calloc(w.n_jobs, sizeof(format_job))) == NULL)
+		return 0;
+	// Number the entries of each subtree
+	c = cx9r_kt_group_get_children(g);
+	for (j = 0; j < w.n_jobs; j++, c = cx9r_kt_group_get_next(c)) {
+		w.jobs[j].group = c;
+		w.jobs[j].n = n;
+		cx9r_kt_iter_init(&it, c, CX9R_KT_ITER_ENTRIES);
+		while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END)
+			if (event == CX9R_KT_ITER_ENTRY) n++;
+	}
+	if (n < PARALLEL_MIN_ENTRIES) {
+		free(w.jobs);
+		return 0;
+	}
+	if (n_threads > (long)w.n_jobs) n_threads = w.n_jobs;
+	for (i = 1; i < n_threads; i++)
+		if (pthread_create(&threads[started], NULL, format_worker, &w) == 0)
+			started++;
+	format_worker(&w);
+	for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+	for (j = 0; j < w.n_jobs; j++) {
+		if (j) out_str(&out, sep);
+		// A buffer that could not be allocated is formatted again here
+		if (w.jobs[j].o.err) fn(&out, w.jobs[j].group, &w.jobs[j].n, 0);
+		else out_mem(&out, w.jobs[j].o.buf, w.jobs[j].o.len);
+		out_close(&w.jobs[j].o);
+	}
+	free(w.jobs);
+	return 1;
+}
+
+// Write the output in format fn for the whole tree below g
+static void format_output(format_fn fn, cx9r_kt_group *g, char const *sep,
+		char const *end) {
+	cx9r_kt_group *c;
+	size_t n = 0;
+	fn(&out, g, &n, 1);
+	if (!format_parallel(fn, g, n, sep))
+		for (c = cx9r_kt_group_get_children(g); c != NULL; c = cx9r_kt_group_get_next(c)) {
+			if (c != cx9r_kt_group_get_children(g)) out_str(&out, sep);
+			fn(&out, c, &n, 0);
 		}
-		if (strcmp(f->name, "Password") == 0)
-			printf("%s%s%s", HIDEPW, f->value, RESET);
-		else printf("%s", f->value);
-		if (strcmp(f->name, "Notes") == 0) puts("");
-		else printf("%s\"%s\n", FIELD, RESET);
+	out_str(&out, end);
+}
+
+// Print Tree
+static void indent(output *o, int n) {
+	while(n-- > 0) out_str(o, GROUP "|" RESET " ");
+}
+static void dump_tree_field(output *o, cx9r_kt_field *f, int depth) {
+	if (f->value == NULL || !field_shown(f)) return;
+	indent(o, depth);
+	if (f->id != CX9R_FIELD_NOTES) {
+		out_str(o, FIELD);
+		out_str(o, f->name);
+		out_str(o, ": \"" RESET);
 	}
-	if (f->next != NULL) dump_tree_field(f->next, depth);
+	if (f->id == CX9R_FIELD_PASSWORD) out_colored(o, HIDEPW, f->value);
+	else out_str(o, f->value);
+	if (f->id == CX9R_FIELD_NOTES) out_char(o, '\n');
+	else out_str(o, FIELD "\"" RESET "\n");
 }
 
-static void dump_tree_entry(cx9r_kt_group *g, cx9r_kt_entry *e, int depth) {
-	if (check_filter(e, g)) {
-		indent(depth-1);
-		if (e->name != NULL) printf("%s%s%s\n", TITLE, e->name, RESET);
-		if (e->fields != NULL) dump_tree_field(e->fields, depth);
-		else puts("");
+static void dump_tree_entry(output *o, cx9r_kt_entry *e, int depth) {
+	indent(o, depth);
+	if (e->name != NULL) {
+		out_colored(o, TITLE, e->name);
+		out_char(o, '\n');
 	}
-	if (e->next != NULL) dump_tree_entry(g, e->next, depth);
+	if (e->fields == NULL) out_char(o, '\n');
 }
 
-static void dump_tree_group(cx9r_kt_group *g, int depth) {
-	indent(depth);
-	if (g->name != NULL) printf("%s%s%s", GROUP, g->name, RESET);
-	puts("");
-	if (g->entries != NULL) dump_tree_entry(g, g->entries, depth + 1);
-	if (g->next != NULL) dump_tree_group(g->next, depth);
-	if (g->children != NULL) dump_tree_group(g->children, depth + 1);
+static void dump_tree_group(output *o, cx9r_kt_group *g, int depth) {
+	indent(o, depth);
+	if (g->name != NULL) out_colored(o, GROUP, g->name);
+	out_char(o, '\n');
+}
+
+// Entries and their fields are indented like the group they are in
+static void dump_tree(output *o, cx9r_kt_group *g, size_t *n, int own) {
+	cx9r_kt_iter it;
+	int show = 0, depth = cx9r_kt_group_get_depth(g);
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_FIELDS);
+	for (;;) switch (cx9r_kt_iter_next(&it)) {
+		case CX9R_KT_ITER_GROUP:
+			if (own && it.depth > 0) return;
+			dump_tree_group(o, it.group, depth + it.depth);
+			break;
+		case CX9R_KT_ITER_ENTRY:
+			if ((show = check_filter((*n)++)))
+				dump_tree_entry(o, it.entry, depth + it.depth - 1);
+			break;
+		case CX9R_KT_ITER_FIELD:
+			if (show) dump_tree_field(o, it.field, depth + it.depth - 2);
+			break;
+		default:
+			return;
+	}
+}
+
+// Write the path of g with put(), from a buffer on the stack unless it
+// is long; the tree is only read, so this is safe on worker threads
+#define PATH_BUF 256
+static void out_path(output *o, cx9r_kt_group *g,
+		void (*put)(output *, const char *)) {
+	char buf[PATH_BUF], *path = buf;
+	size_t n = cx9r_kt_group_get_path_length(g) + 1;
+	if (n > sizeof(buf) && (path = malloc(n)) == NULL) {
+		o->err = ENOMEM;
+		return;
+	}
+	put(o, cx9r_kt_group_get_path(g, path));
+	if (path != buf) free(path);
 }
 
 // Print CSV
-void print_key_table(cx9r_kt_group *g, int level) {
-	cx9r_kt_entry *e = cx9r_kt_group_get_entries(g);
-	puts("\"Group\",\"Title\",\"Username\",\"Password\",\"URL\",\"Notes\"");
-	while (e != NULL) {
-		if (check_filter(e, g)) {
-			char *username = dq(getfield(e, "UserName")),
-				*password = dq(getfield(e, "Password")),
-				*url = dq(getfield(e, "URL")),
-				*notes = dq(getfield(e, "Notes"));
-			printf("\"%s\",\"%s\",\"%s\",\"%s\",\"%s\",\"%s\"\n",
-					cx9r_kt_group_get_name(g), cx9r_kt_entry_get_name(e),
-					username, password, url, notes);
-			// Allocated in helper.c::dq()
-			free(username);
-			free(password);
-			free(url);
-			free(notes);
+#define COLUMN_GROUP (-2)
+#define COLUMN_PATH (-3)
+typedef struct {
+	const char *name;
+	int id;  // field id, or COLUMN_GROUP/COLUMN_PATH
+} csv_column;
+
+csv_column *csv_columns = NULL;
+size_t n_csv_columns = 0;
+
+// Resolve a column name: Group, Path, a field name, or the case-insensitive
+// name of a standard field; unknown fields are left empty
+static int column_id(cx9r_key_tree *kt, const char *name) {
+	if (strcasecmp(name, "Group") == 0) return COLUMN_GROUP;
+	if (strcasecmp(name, "Path") == 0) return COLUMN_PATH;
+	return field_id(kt, name);
+}
+
+static const char *column_value(csv_column const *c, cx9r_kt_group *g,
+		cx9r_kt_entry *e) {
+	const char *value = NULL;
+	if (c->id == COLUMN_GROUP) value = cx9r_kt_group_get_name(g);
+	else if (c->id != CX9R_FIELD_NONE) value = cx9r_kt_entry_get_value(e, c->id);
+	return value ? value : "";
+}
+
+static void print_key_rows(output *o, cx9r_kt_group *g, size_t *n, int own) {
+	cx9r_kt_iter it;
+	size_t i;
+	int event;
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_ENTRIES);
+	while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		if (own && event == CX9R_KT_ITER_GROUP && it.depth > 0) return;
+		if (event != CX9R_KT_ITER_ENTRY || !check_filter((*n)++)) continue;
+		for (i = 0; i < n_csv_columns; i++) {
+			if (i) out_char(o, ',');
+			if (csv_columns[i].id == COLUMN_PATH) out_path(o, it.group, out_csv);
+			else out_csv(o, column_value(&csv_columns[i], it.group, it.entry));
+		}
+		out_char(o, '\n');
+	}
+}
+
+int print_key_table(cx9r_key_tree *kt) {
+	char **names = split_list(columns);
+	size_t i;
+	if (names == NULL) return -1;
+	for (n_csv_columns = 0; names[n_csv_columns] != NULL; n_csv_columns++);
+	if ((csv_columns = malloc(n_csv_columns * sizeof(csv_column))) == NULL) {
+		free(names);
+		return -1;
+	}
+	for (i = 0; i < n_csv_columns; i++) {
+		csv_columns[i].name = names[i];
+		csv_columns[i].id = column_id(kt, names[i]);
+		if (i) out_char(&out, ',');
+		out_csv(&out, names[i]);
+	}
+	out_char(&out, '\n');
+	format_output(print_key_rows, cx9r_key_tree_get_root(kt), "", "");
+	free(csv_columns);
+	free(names);
+	return 0;
+}
+
+// Print JSON
+static void json_string(output *o, const char *s) {
+	if (s == NULL) out_str(o, "null");
+	else out_json(o, s);
+}
+
+static void json_uuid(output *o, uint8_t const *u) {
+	static const char hex[] = "0123456789abcdef";
+	char buf[2 * CX9R_UUID_LENGTH + 2];
+	int i;
+	buf[0] = buf[sizeof(buf) - 1] = '"';
+	for (i = 0; i < CX9R_UUID_LENGTH; i++) {
+		buf[2 * i + 1] = hex[u[i] >> 4];
+		buf[2 * i + 2] = hex[u[i] & 15];
+	}
+	out_mem(o, buf, sizeof(buf));
+}
+
+// Members of an entry object, all fields but the Title under "fields"
+static void json_entry(output *o, cx9r_kt_entry *e) {
+	cx9r_kt_field *f;
+	int first = 1;
+	out_str(o, "\"uuid\":");
+	json_uuid(o, cx9r_kt_entry_get_uuid(e));
+	out_str(o, ",\"title\":");
+	json_string(o, cx9r_kt_entry_get_name(e));
+	out_str(o, ",\"fields\":{");
+	for (f = cx9r_kt_entry_get_fields(e); f != NULL; f = cx9r_kt_field_get_next(f)) {
+		if (cx9r_kt_field_get_value(f) == NULL || !field_shown(f)) continue;
+		if (!first) out_char(o, ',');
+		first = 0;
+		json_string(o, cx9r_kt_field_get_name(f));
+		out_char(o, ':');
+		json_string(o, cx9r_kt_field_get_value(f));
+	}
+	out_char(o, '}');
+}
+
+// An entry object with the name and path of its group
+static void json_entry_in_group(output *o, cx9r_kt_group *g, cx9r_kt_entry *e) {
+	out_str(o, "{\"group\":");
+	json_string(o, cx9r_kt_group_get_name(g));
+	out_str(o, ",\"path\":");
+	out_path(o, g, out_json);
+	out_char(o, ',');
+	json_entry(o, e);
+	out_char(o, '}');
+}
+
+// Groups nest with their selected entries first, like the tree output;
+// open tracks the depth of the innermost group whose list of groups is open
+static void dump_json_group(output *o, cx9r_kt_group *g, size_t *n, int own) {
+	cx9r_kt_iter it;
+	int event, open = -1, entries = 0, first = 1;
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_ENTRIES);
+	while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		if (event == CX9R_KT_ITER_ENTRY) {
+			if (!check_filter((*n)++)) continue;
+			out_str(o, first ? "{" : ",{");
+			first = 0;
+			json_entry(o, it.entry);
+			out_char(o, '}');
+			continue;
+		}
+		if (entries) out_str(o, "],\"groups\":[");
+		if (own && it.depth > 0) return;
+		// close the groups this one follows, then separate it from them
+		if (open >= it.depth) {
+			for (; open >= it.depth; open--) out_str(o, "]}");
+			out_char(o, ',');
+		}
+		open = it.depth;
+		entries = first = 1;
+		out_str(o, "{\"uuid\":");
+		json_uuid(o, cx9r_kt_group_get_uuid(it.group));
+		out_str(o, ",\"name\":");
+		json_string(o, cx9r_kt_group_get_name(it.group));
+		out_str(o, ",\"entries\":[");
+	}
+	if (entries) out_str(o, "],\"groups\":[");
+	if (own) return;
+	for (; open >= 0; open--) out_str(o, "]}");
+}
+
+// One object per line for each selected entry, with its group and path
+static void dump_json_lines(output *o, cx9r_kt_group *g, size_t *n, int own) {
+	cx9r_kt_iter it;
+	int event;
+	cx9r_kt_iter_init(&it, g, CX9R_KT_ITER_ENTRIES);
+	while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+		if (own && event == CX9R_KT_ITER_GROUP && it.depth > 0) return;
+		if (event != CX9R_KT_ITER_ENTRY || !check_filter((*n)++)) continue;
+		json_entry_in_group(o, it.group, it.entry);
+		out_char(o, '\n');
+	}
+}
+
+// Whether the word before the first colon is group or a field name, so
+// that a URL or a host:port is searched for instead of taken as a query
+static int field_scoped(cx9r_key_tree *kt, char const *q) {
+	char const *colon = strchr(q, ':'), *start;
+	char *name;
+	int scoped;
+	if (colon == NULL) return 0;
+	for (start = colon; start > q && start[-1] != ' ' && start[-1] != '\t'
+			&& start[-1] != '('; start--);
+	if ((name = strndup(start, colon - start)) == NULL) return 0;
+	scoped = strcasecmp(name, "group") == 0
+			|| field_id(kt, name) != CX9R_FIELD_NONE;
+	free(name);
+	return scoped;
+}
+
+// Batch: answer queries read from stdin, ended by a newline or a NUL, each
+// with one JSON record ended by the same character. A query is a UUID, a
+// query like for -q when the word before its first colon is group or a
+// field name, or else a string searched like for -s.
+static void batch_record(cx9r_key_tree *kt, char *q, char end) {
+	uint8_t u[CX9R_UUID_LENGTH];
+	cx9r_kt_iter it;
+	size_t n = 0;
+	int event, first = 1;
+	search = q;
+	uuid = parse_uuid(u, q);
+	query = !uuid && field_scoped(kt, q);
+	selected = select_entries(kt);
+	out_str(&out, "{\"query\":");
+	out_json(&out, q);
+	// A query that failed has its reason on stderr
+	if (selected == NULL) out_str(&out, ",\"entries\":null}");
+	else {
+		out_str(&out, ",\"entries\":[");
+		cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_ENTRIES);
+		while ((event = cx9r_kt_iter_next(&it)) != CX9R_KT_ITER_END) {
+			if (event != CX9R_KT_ITER_ENTRY || !check_filter(n++)) continue;
+			if (!first) out_char(&out, ',');
+			first = 0;
+			json_entry_in_group(&out, it.group, it.entry);
+		}
+		out_str(&out, "]}");
+	}
+	out_char(&out, end);
+	out_flush(&out);
+	free(selected);
+	selected = NULL;
+}
+
+int run_batch(cx9r_key_tree *kt, FILE *in) {
+	char *line = NULL, *p;
+	size_t size = 0, len = 0;
+	int c;
+	while ((c = getc(in)) != EOF || len > 0) {
+		if (c != EOF && c != '\n' && c != 0) {
+			if (len + 1 >= size) {
+				if ((p = realloc(line, size = 2 * size + 256)) == NULL) {
+					free(line);
+					return -1;
+				}
+				line = p;
+			}
+			line[len++] = c;
+			continue;
 		}
-		e = cx9r_kt_entry_get_next(e);
+		if (len == 0) continue;
+		line[len] = 0;
+		len = 0;
+		batch_record(kt, line, c == 0 ? 0 : '\n');
+	}
+	free(line);
+	return 0;
+}
+
+// Agent: answer the queries of a connection like --batch does
+static int serve_connection(int conn, void *kt) {
+	FILE *in = fdopen(conn, "r");
+	int r = -1;
+	if (in == NULL) close(conn);
+	else if (out_open(&out, conn) == 0) r = run_batch(kt, in);
+	out_close(&out);
+	if (in != NULL) fclose(in);
+	return r;
+}
+
+// Listen, then serve from a child process in the background, with its
+// memory locked; the parent returns right away
+int run_agent(cx9r_key_tree *kt) {
+	char *path = agent_socket_path();
+	int fd = path == NULL ? -1 : agent_listen(path);
+	pid_t pid;
+	if (fd < 0) {
+		if (fd == -2) fprintf(stderr, "%sAn agent is running already on %s\n",
+			ERRC, path);
+		else fprintf(stderr, "%sCan't listen on %s\n", ERRC,
+			path == NULL ? "a safe socket" : path);
+		free(path);
+		return -1;
+	}
+	out_close(&out);
+	fflush(stdout);
+	if ((pid = fork()) != 0) {
+		if (pid < 0) unlink(path);
+		else printf("Agent %d listening on %s\n", (int)pid, path);
+		close(fd);
+		free(path);
+		return pid < 0 ? -1 : 0;
 	}
-	cx9r_kt_group *c = cx9r_kt_group_get_children(g);
-	while(c != NULL) {
-		print_key_table(c, level + 1);
-		c = cx9r_kt_group_get_next(c);
+	setsid();
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		fprintf(stderr, "%sCan't lock the agent's memory%s\n", WARNC, RESET);
+	int null = open("/dev/null", O_RDWR);
+	if (null >= 0) {
+		dup2(null, STDIN_FILENO);
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		if (null > STDERR_FILENO) close(null);
 	}
+	agent_serve(fd, path, agent_timeout, serve_connection, kt);
+	free(path);
+	return 0;
+}
+
+// Memory report
+typedef struct {
+	char const *name;
+	size_t bytes;
+	size_t count;
+} string_use;
+
+static int by_bytes(const void *a, const void *b) {
+	size_t x = ((string_use const *)a)->bytes, y = ((string_use const *)b)->bytes;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void print_counter(char const *name, cx9r_mem_counter const *c) {
+	printf("  %-12s %10zu bytes peak in %zu allocations\n", name, c->peak,
+			c->n_allocs);
+}
+
+// Report on kt, loaded from n_loaded databases
+void print_mem_report(cx9r_key_tree *kt, size_t n_loaded) {
+	size_t n_names = kt->atoms.n_names, n[3] = {0, 0, 0}, strings = 0, i;
+	// One row per field name, then group names and the interned names
+	string_use *use = calloc(n_names + 2, sizeof(string_use));
+	if (use == NULL) {
+		fprintf(stderr, "%sOut of memory\n", ERRC);
+		return;
+	}
+	for (i = 0; i < n_names; i++)
+		use[i].name = cx9r_key_tree_get_field_name(kt, i);
+	use[n_names].name = "(group names)";
+	use[n_names + 1].name = "(field names)";
+	for (i = 0; i < n_names; i++) {
+		use[n_names + 1].bytes += strlen(use[i].name) + 1;
+		use[n_names + 1].count++;
+	}
+	cx9r_kt_iter it;
+	cx9r_kt_iter_init(&it, cx9r_key_tree_get_root(kt), CX9R_KT_ITER_FIELDS);
+	for (;;) {
+		string_use *u = NULL;
+		char const *value = NULL;
+		switch (cx9r_kt_iter_next(&it)) {
+		case CX9R_KT_ITER_GROUP:
+			n[0]++;
+			u = &use[n_names];
+			value = it.group->name;
+			break;
+		case CX9R_KT_ITER_ENTRY:
+			n[1]++;
+			u = &use[CX9R_FIELD_TITLE];
+			value = it.entry->name;
+			break;
+		case CX9R_KT_ITER_FIELD:
+			n[2]++;
+			if (it.field->id >= 0) u = &use[it.field->id];
+			value = it.field->value;
+			break;
+		}
+		if (it.event == CX9R_KT_ITER_END) break;
+		if (u == NULL || value == NULL) continue;
+		u->bytes += strlen(value) + 1;
+		u->count++;
+	}
+	qsort(use, n_names + 2, sizeof(string_use), by_bytes);
+
+	printf("Groups:  %zu\nEntries: %zu\nFields:  %zu\n", n[0], n[1], n[2]);
+	puts("String bytes by field name:");
+	for (i = 0; i < n_names + 2; i++) {
+		strings += use[i].bytes;
+		if (use[i].count > 0)
+			printf("  %-20s %10zu bytes in %zu strings\n", use[i].name,
+					use[i].bytes, use[i].count);
+	}
+	free(use);
+
+	size_t reserved, used, chunks, nodes = n[0] * sizeof(cx9r_kt_group)
+			+ n[1] * sizeof(cx9r_kt_entry) + n[2] * sizeof(cx9r_kt_field);
+	cx9r_arena_get_usage(&kt->arena, &reserved, &used, &chunks);
+	puts("Tree:");
+	printf("  %-12s %10zu bytes\n", "nodes", nodes);
+	printf("  %-12s %10zu bytes\n", "strings", strings);
+	printf("  %-12s %10zu bytes in %zu chunks, %zu used\n", "arena", reserved,
+			chunks, used);
+	printf("  %-12s %10zu bytes (padding, headers, unused, indexes)\n",
+			"overhead", reserved - nodes - strings);
+	printf("  %-12s %10zu bytes (field names, uuid index)\n", "tables",
+			kt->atoms.names_capacity * sizeof(char const *)
+			+ kt->atoms.slots_capacity * sizeof(int)
+			+ (kt->uuid_slots != NULL ? kt->uuid_capacity : 0)
+			* sizeof(cx9r_kt_uuid_slot));
+
+	cx9r_mem_stats const *stats = cx9r_mem_get_stats();
+	// The counters and the RSS of the process are shared by all loads
+	if (n_loaded > 1)
+		printf("Loading and peak RSS of all %zu databases, loaded at once:\n",
+				n_loaded);
+	puts("Loading:");
+	print_counter("decrypt", &stats->areas[CX9R_MEM_DECRYPT]);
+	print_counter("gzip", &stats->areas[CX9R_MEM_GZIP]);
+	print_counter("xml", &stats->areas[CX9R_MEM_XML]);
+	puts("Peak RSS:");
+	printf("  %-12s %10ld kB\n", "start", stats->peak_rss_kb[CX9R_MEM_PHASE_START]);
+	printf("  %-12s %10ld kB\n", "key", stats->peak_rss_kb[CX9R_MEM_PHASE_KEY]);
+	printf("  %-12s %10ld kB\n", "parse", stats->peak_rss_kb[CX9R_MEM_PHASE_PARSE]);
+}
+
+// Snapshot of kdbxfile in $XDG_CACHE_HOME/kdbxviewer or ~/.cache/kdbxviewer,
+// named after the SHA-256 of the absolute path of the database, which
+// keeps the name short and distinct for every path
+char *snapshot_path(char const *configfile, char const *kdbxfile) {
+	static const char hex[] = "0123456789abcdef";
+	char real[PATH_MAX], *path, *p, *xdg = getenv("XDG_CACHE_HOME");
+	uint8_t hash[CX9R_SHA256_HASH_LENGTH];
+	size_t i;
+	// HOME has been extended to the configfile
+	size_t home = strlen(configfile) - strlen(CONFIGFILE);
+	if (realpath(kdbxfile, real) == NULL) return NULL;
+	if ((path = malloc(home + 2 * sizeof(hash) + 32 +
+			(xdg != NULL ? strlen(xdg) : 0))) == NULL) return NULL;
+	if (xdg != NULL && *xdg == '/') strcpy(path, xdg);
+	else {
+		memcpy(path, configfile, home);
+		strcpy(path + home, "/.cache");
+	}
+	mkdir(path, 0700);
+	strcat(path, "/kdbxviewer");
+	mkdir(path, 0700);
+	strcat(path, "/");
+	cx9r_sha256_hash_buffer(hash, (uint8_t *)real, strlen(real));
+	for (p = path + strlen(path), i = 0; i < sizeof(hash); i++) {
+		*p++ = hex[hash[i] >> 4];
+		*p++ = hex[hash[i] & 15];
+	}
+	strcpy(p, ".snap");
+	return path;
+}
+
+// Databases given with -d, loaded together and merged into one tree
+typedef struct {
+	char const *file;
+	FILE *f;
+	char *password;
+	char *snapshot;
+	cx9r_key_tree *kt;
+	cx9r_err err;
+} database;
+
+database *databases = NULL;
+size_t n_databases = 0;
+
+int add_database(char const *file, FILE *f) {
+	database *d = realloc(databases, (n_databases + 1) * sizeof(database));
+	if (d == NULL) return -1;
+	databases = d;
+	d += n_databases++;
+	memset(d, 0, sizeof(database));
+	d->file = file;
+	d->f = f;
+	return 0;
+}
+
+typedef struct {
+	int flags;
+	char const *const *keep;
+	size_t next;  // next database to be loaded, advanced atomically
+} load_work;
+
+static void *load_worker(void *arg) {
+	load_work *w = arg;
+	database *d;
+	size_t i;
+	while ((i = __sync_fetch_and_add(&w->next, 1)) < n_databases) {
+		d = &databases[i];
+		d->err = cx9r_kdbx_read_fields(d->f, d->password, w->flags, d->snapshot,
+			w->keep, &d->kt);
+	}
+	return NULL;
+}
+
+// Load all databases, on up to one thread per processor, as each spends
+// most of its time in its own key derivation; XML is dumped one by one
+static void load_databases(int flags, char const *const *keep) {
+	load_work w = {flags, keep, 0};
+	pthread_t threads[PARALLEL_MAX_THREADS];
+	long n_threads = sysconf(_SC_NPROCESSORS_ONLN), i, started = 0;
+	if (n_threads > PARALLEL_MAX_THREADS) n_threads = PARALLEL_MAX_THREADS;
+	if (n_threads > (long)n_databases) n_threads = n_databases;
+	if (flags & FLAG_DUMP_XML) n_threads = 1;
+	for (i = 1; i < n_threads; i++)
+		if (pthread_create(&threads[started], NULL, load_worker, &w) == 0)
+			started++;
+	load_worker(&w);
+	for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+// One tree with a top-level group per database, named after its file,
+// holding a copy of the database's tree; frees the trees of the databases
+static cx9r_key_tree *merge_databases() {
+	cx9r_key_tree *kt = cx9r_key_tree_create();
+	cx9r_kt_group *g;
+	char const *name;
+	size_t i;
+	// Named like the root of a single database, which is printed too
+	if (kt != NULL && cx9r_kt_group_set_zname(cx9r_key_tree_get_root(kt),
+			"Root") == NULL) {
+		cx9r_key_tree_free(kt);
+		return NULL;
+	}
+	for (i = 0; kt != NULL && i < n_databases; i++) {
+		name = strrchr(databases[i].file, '/');
+		name = name != NULL ? name + 1 : databases[i].file;
+		if ((g = cx9r_kt_group_copy(cx9r_key_tree_get_root(kt),
+				cx9r_key_tree_get_root(databases[i].kt))) == NULL
+				|| cx9r_kt_group_set_zname(g, name) == NULL) {
+			cx9r_key_tree_free(kt);
+			return NULL;
+		}
+		cx9r_key_tree_free(databases[i].kt);
+		databases[i].kt = NULL;
+	}
+	// Of the same UUID in several databases, the first one is found
+	if (kt != NULL) cx9r_key_tree_index_uuids(kt);
+	return kt;
+}
+
+// Explain an error from loading a database
+static void report_error(cx9r_err err) {
+	fprintf(stderr, WARNC);
+	// See include/cx9r.h for error codes
+	if (err == 3 || err == 16) fprintf(stderr, "Password invalid\n");
+	else if (err == CX9R_BAD_MAGIC)
+		fprintf(stderr, "Not a KeePass databases\n");
+	else if (err == CX9R_UNSUPPORTED_VERSION)
+		fprintf(stderr, "Unsupported KeePass database version\n");
+	else if (err == CX9R_FILE_READ_ERR)
+		fprintf(stderr, "Error reading KeePass database\n");
+	else if (err == CX9R_UNKNOWN_INNER_RANDOM_STREAM)
+		fprintf(stderr, "Unsupported protected value encryption\n");
+	else fprintf(stderr, "KeePass Database error %d\n", err);
+	fprintf(stderr, RESET);
 }
 
 // Process commandline
@@ -160,9 +1014,26 @@ int main(int argc, char **argv) {
 
 	while (self >= argv[0] && *self != '/') --self;
 	++self;
-	while ((opt = getopt(argc, argv, "xictp:uAs:S:d:Vh")) != -1) {
+	static struct option const longopts[] = {
+		{"uuid", required_argument, NULL, 'U'},
+		{"cache", no_argument, NULL, 'C'},
+		{"mem-report", no_argument, NULL, 'M'},
+		{"columns", required_argument, NULL, 'L'},
+		{"batch", no_argument, NULL, 'B'},
+		{"agent", no_argument, NULL, 'G'},
+		{"agent-timeout", required_argument, NULL, 'T'},
+		{"use-agent", no_argument, NULL, 'Y'},
+		{NULL, 0, NULL, 0}
+	};
+	while ((opt = getopt_long(argc, argv, "xicjJtp:uIf:As:S:q:r:d:Vh", longopts,
+			NULL)) != -1) {
 		switch (opt) {
 		case 'x': flags = 2;
+		case 'M':
+		case 'B':
+		case 'G':
+		case 'j':
+		case 'J':
 		case 'c':
 		case 't':
 		case 'i':
@@ -177,9 +1048,45 @@ int main(int argc, char **argv) {
 		case 'u':
 			unmask = 1;
 			break;
+		case 'I':
+			ignorecase = TRUE;
+			break;
 		case 'p':
 			password = optarg;
 			break;
+		case 'q':
+			if (search != NULL)
+				abort(-2, "%sSuperfluous query: %s\n", ERRC, optarg);
+			query = TRUE;
+			search = optarg;
+			break;
+		case 'r':
+			if (search != NULL)
+				abort(-2, "%sSuperfluous regular expression: %s\n", ERRC, optarg);
+			regex = TRUE;
+			search = optarg;
+			break;
+		case 'f':
+			fields = optarg;
+			break;
+		case 'T':
+			agent_timeout = atoi(optarg);
+			break;
+		case 'Y':
+			use_agent = TRUE;
+			break;
+		case 'L':
+			columns = optarg;
+			break;
+		case 'C':
+			cache = TRUE;
+			break;
+		case 'U':
+			if (search != NULL)
+				abort(-2, "%sSuperfluous UUID: %s\n", ERRC, optarg);
+			uuid = TRUE;
+			search = optarg;
+			break;
 		case 'S':
 			searchall = TRUE;
 		case 's':
@@ -190,7 +1097,13 @@ int main(int argc, char **argv) {
 		case 'd':
 			if ((kdbx = fopen(optarg, "r")) == NULL)
 				abort(-3, "%sCan't open database file: %s\n", ERRC, optarg);
-			kdbxfile = optarg;
+			if (add_database(optarg, kdbx) != 0)
+				abort(-3, "%sOut of memory\n", ERRC);
+			// The first names the view; a copy, as abort() frees it
+			if (n_databases > 1) break;
+			free(kdbxfile);
+			if ((kdbxfile = strdup(optarg)) == NULL)
+				abort(-3, "%sOut of memory\n", ERRC);
 		}
 	}
 
@@ -210,6 +1123,23 @@ int main(int argc, char **argv) {
 	if (optind < argc)
 		abort(-5, "%sSuperfluous argument: %s", ERRC, argv[optind]);
 
+	if (use_agent) { // Let the agent answer, without opening the database
+		char *path = agent_socket_path();
+		if (search == NULL && command != 'B')
+			abort(-4, "%sA query or --batch is needed with --use-agent\n", ERRC);
+		// The agent answers like --batch does, so nothing else would apply
+		if ((command != 0 && command != 'B') || query || regex || searchall
+				|| ignorecase || fields != NULL || columns != NULL || n_databases > 0)
+			abort(-4, "%s--use-agent takes no other command, -q, -r, -S, -I, -f,"
+				" --columns or -d\n", ERRC);
+		if (path == NULL || agent_ask(path, search) != 0) {
+			free(path);
+			abort(-9, "%sNo agent is running\n", ERRC);
+		}
+		free(path);
+		return 0;
+	}
+
 	if (*kdbxfile == 0) { // Try configfile for database filename
 		*kdbxconf = 0;
 		if ((config = fopen(configfile, "r")) != NULL)
@@ -223,39 +1153,107 @@ int main(int argc, char **argv) {
 			abort(-6, "%sNo database specified on commandline or in configfile\n",
 				ERRC);
 		else strcpy(kdbxconf, kdbxfile);
+		if (add_database(kdbxfile, kdbx) != 0)
+			abort(-3, "%sOut of memory\n", ERRC);
 	}
 
+	if ((command == 'B' || command == 'G') && search != NULL)
+		abort(-4, "%sBatch queries are read from stdin: %s\n", ERRC, search);
 	if (command == 0) command = (search == NULL) ? 'i' : 't';
+	if (command != 't' && command != 'c' && command != 'j' && command != 'J'
+			&& command != 'B' && command != 'G')
+		fields = NULL;
+	if (columns == NULL) columns = fields != NULL ? fields : DEFAULT_COLUMNS;
+	// Fields that are not output are not even kept while parsing, unless
+	// they are needed for selecting or for a snapshot of the whole tree
+	char **keep = NULL;
+	if ((command == 'c' || fields != NULL) && !searchall && !query && !regex
+			&& !cache && command != 'B' && command != 'G'
+			&& (keep = split_list(command == 'c' ? columns : fields)) == NULL)
+		abort(-8, "%sOut of memory\n", ERRC);
 
-	// Open the database
+	// Open the databases, all with the same password
 	if (password == NULL) {
-		warn("Opening database %s%s\n%sPassword: %s", FIELD, kdbxfile, PWC, RESET);
+		warn("Opening database %s%s%s\n%sPassword: %s", FIELD, kdbxfile,
+			n_databases > 1 ? " and others" : "", PWC, RESET);
 		password = getpass("");
 	}
 	cx9r_key_tree *kt = NULL;
-	cx9r_err err = cx9r_kdbx_read(kdbx, password, flags, &kt);
+	cx9r_err err = 0;
+	size_t i;
+	for (i = 0; i < n_databases; i++) {
+		database *d = &databases[i];
+		// Each is wiped by the loading, so each gets its own copy
+		if ((d->password = n_databases > 1 ? strdup(password) : password) == NULL)
+			abort(-8, "%sOut of memory\n", ERRC);
+		d->snapshot = cache ? snapshot_path(configfile, d->file) : NULL;
+		if (cache && d->snapshot == NULL)
+			warn("%sCan't use a snapshot of %s%s\n", WARNC, d->file, RESET);
+	}
+	if (n_databases > 1) memset(password, 0, strlen(password));
+	cx9r_mem_sample(CX9R_MEM_PHASE_START);
+	load_databases(flags, (char const *const *)keep);
+	for (i = 0; i < n_databases; i++) {
+		database *d = &databases[i];
+		if (d->err && !err) err = d->err;
+		if (d->err && n_databases > 1) warn("%s%s: ", WARNC, d->file);
+		if (d->err) report_error(d->err);
+		if (n_databases > 1) free(d->password);
+		free(d->snapshot);
+	}
+	free(keep);
+	if (!err && !(flags & FLAG_DUMP_XML)) {
+		if (n_databases == 1) kt = databases[0].kt;
+		else if ((kt = merge_databases()) == NULL) {
+			warn("%sOut of memory\n%s", ERRC, RESET);
+			err = -8;
+		}
+	}
 	if (!err) {
+		// Only a single database is remembered for the next time
 		if ((config = fopen(configfile, "a")) == NULL)
 			warn("%sCan't write to configfile %s%s\n", WARNC, configfile, RESET);
-		else if (strcmp(kdbxconf, kdbxfile) != 0)
+		else if (n_databases == 1 && strcmp(kdbxconf, kdbxfile) != 0)
 			fprintf(config, "%s\n", kdbxfile);
-		if (command == 't') dump_tree_group(&kt->root, 0);
-		if (command == 'c') print_key_table(cx9r_key_tree_get_root(kt), 0);
-		if (command == 'i') run_interactive_mode(kdbxfile, kt);
-	}
-	else {
-		warn(WARNC);
-		// See include/cx9r.h for error codes
-		if (err == 3 || err == 16) warn("Password invalid\n");
-		else if (err == CX9R_BAD_MAGIC)
-			warn("Not a KeePass databases\n");
-		else if (err == CX9R_UNSUPPORTED_VERSION)
-			warn("Unsupported KeePass database version\n");
-		else if (err == CX9R_FILE_READ_ERR)
-			warn("Error reading KeePass database\n");
-		else warn("KeePass Database error %d\n", err);
-		warn(RESET);
+		if (search != NULL && (selected = select_entries(kt)) == NULL) {
+			warn(RESET);
+			err = -7;
+		}
+		else if ((fields != NULL && select_fields(kt) != 0)
+				|| out_open(&out, STDOUT_FILENO) != 0) {
+			warn("%sOut of memory\n%s", ERRC, RESET);
+			err = -8;
+		}
+		else {
+			if (command == 't') format_output(dump_tree, &kt->root, "", "");
+			if (command == 'c' && print_key_table(kt) != 0) {
+				warn("%sOut of memory\n%s", ERRC, RESET);
+				err = -8;
+			}
+			if (command == 'j')
+				format_output(dump_json_group, cx9r_key_tree_get_root(kt), ",", "]}\n");
+			if (command == 'J')
+				format_output(dump_json_lines, cx9r_key_tree_get_root(kt), "", "");
+			if (command == 'B' && run_batch(kt, stdin) != 0) {
+				warn("%sOut of memory\n%s", ERRC, RESET);
+				err = -8;
+			}
+			if (command == 'G' && run_agent(kt) != 0) err = -9;
+			if (command == 'M') print_mem_report(kt, n_databases);
+			if (command == 'i') run_interactive_mode(kdbxfile, kt);
+			out_close(&out);
+		}
 	}
 	if (kt != NULL) cx9r_key_tree_free(kt);
+	// Trees of databases that were not merged, as another failed
+	if (n_databases > 1)
+		for (i = 0; i < n_databases; i++)
+			if (databases[i].kt != NULL) cx9r_key_tree_free(databases[i].kt);
+	free(databases);
+	free(kdbxfile);
+	free(kdbxconf);
+	free(selected);
+	free(shown_fields);
+	cx9r_trigram_index_free(trigram_index);
 	return err;
 }
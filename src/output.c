@@ -0,0 +1,167 @@
+// output.c
+
+#include <stdio.h>  // for fflush
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // for write
+#include <errno.h>
+
+#include "output.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define RESET "\033[0m"
+
+int out_open(output *o, int fd) {
+	o->fd = fd;
+	o->err = 0;
+	o->len = 0;
+	o->size = OUT_SIZE;
+	if ((o->buf = malloc(OUT_SIZE)) == NULL) o->err = ENOMEM;
+	return o->err ? -1 : 0;
+}
+
+// Write all of s, retrying after interrupts and partial writes
+static void write_all(output *o, const char *s, size_t n) {
+	ssize_t w;
+	// Anything still buffered by stdio goes first
+	fflush(stdout);
+	while (n > 0 && !o->err) {
+		if ((w = write(o->fd, s, n)) < 0) {
+			if (errno != EINTR) o->err = errno;
+			continue;
+		}
+		s += w;
+		n -= w;
+	}
+}
+
+int out_flush(output *o) {
+	if (o->fd >= 0) {
+		write_all(o, o->buf, o->len);
+		o->len = 0;
+	}
+	return o->err ? -1 : 0;
+}
+
+int out_close(output *o) {
+	int r = out_flush(o);
+	free(o->buf);
+	o->buf = NULL;
+	return r;
+}
+
+// Make room for n more bytes: write the buffer out, or grow it when there
+// is no file descriptor; returns whether the n bytes fit now
+static int make_room(output *o, size_t n) {
+	size_t size = 2 * o->size;
+	char *buf;
+	if (o->fd >= 0) {
+		out_flush(o);
+		return n < o->size;
+	}
+	if (o->err) return 0;
+	if (size < o->len + n) size = o->len + n;
+	if ((buf = realloc(o->buf, size)) == NULL) {
+		o->err = ENOMEM;
+		return 0;
+	}
+	o->buf = buf;
+	o->size = size;
+	return 1;
+}
+
+void out_mem(output *o, const char *s, size_t n) {
+	if (n > o->size - o->len && !make_room(o, n)) {
+		// Too big to be worth copying
+		if (o->fd >= 0) write_all(o, s, n);
+		return;
+	}
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
+}
+
+void out_str(output *o, const char *s) {
+	out_mem(o, s, strlen(s));
+}
+
+void out_char(output *o, char c) {
+	if (o->len == o->size && !make_room(o, 1)) return;
+	o->buf[o->len++] = c;
+}
+
+// Append s between an ANSI colour code and the reset code
+void out_colored(output *o, const char *color, const char *s) {
+	out_str(o, color);
+	out_str(o, s);
+	out_mem(o, RESET, sizeof(RESET) - 1);
+}
+
+// Append s as a quoted CSV cell, doubling the doublequotes
+void out_csv(output *o, const char *s) {
+	size_t n = strlen(s);
+	const char *q;
+	out_char(o, '"');
+	while ((q = memchr(s, '"', n)) != NULL) {
+		out_mem(o, s, q - s + 1);
+		out_char(o, '"');
+		n -= q - s + 1;
+		s = q + 1;
+	}
+	out_mem(o, s, n);
+	out_char(o, '"');
+}
+
+#define JSON_ESCAPED(c) ((unsigned char)(c) < 0x20 || (c) == '"' || (c) == '\\')
+
+// Length of the run at the start of s that needs no JSON escaping; with
+// SSE2, 16 bytes are checked at once
+static size_t json_plain(const char *s, size_t n) {
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'),
+		control = _mm_set1_epi8(0x1f);
+	__m128i v;
+	int mask;
+	for (; i + 16 <= n; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(s + i));
+		// max(v, 0x1f) == 0x1f for the unsigned bytes up to 0x1f
+		mask = _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(_mm_max_epu8(v, control), control),
+				_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+						_mm_cmpeq_epi8(v, backslash))));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+#endif
+	while (i < n && !JSON_ESCAPED(s[i])) i++;
+	return i;
+}
+
+// Append s as a JSON string
+void out_json(output *o, const char *s) {
+	static const char hex[] = "0123456789abcdef";
+	char esc[6] = {'\\', 'u', '0', '0'};
+	size_t n = strlen(s), i;
+	out_char(o, '"');
+	for (;;) {
+		i = json_plain(s, n);
+		out_mem(o, s, i);
+		if (i == n) break;
+		switch (s[i]) {
+			case '"': out_mem(o, "\\\"", 2); break;
+			case '\\': out_mem(o, "\\\\", 2); break;
+			case '\n': out_mem(o, "\\n", 2); break;
+			case '\r': out_mem(o, "\\r", 2); break;
+			case '\t': out_mem(o, "\\t", 2); break;
+			default:
+				esc[4] = hex[(unsigned char)s[i] >> 4];
+				esc[5] = hex[s[i] & 15];
+				out_mem(o, esc, 6);
+		}
+		s += i + 1;
+		n -= i + 1;
+	}
+	out_char(o, '"');
+}
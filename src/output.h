@@ -0,0 +1,27 @@
+// output.h
+
+#include <stddef.h>
+
+// size of the buffer collected before it is written out
+#define OUT_SIZE 65536
+
+// Output buffer, written to its file descriptor with one write(2) whenever
+// it fills up; the append functions take no locks and parse no formats.
+// Without a file descriptor (-1) the buffer grows to hold all output.
+typedef struct {
+	int fd;
+	int err;  // set once a write or allocation failed, output is discarded
+	size_t len;
+	size_t size;
+	char *buf;
+} output;
+
+int out_open(output *o, int fd);
+int out_flush(output *o);
+int out_close(output *o);
+void out_mem(output *o, const char *s, size_t n);
+void out_str(output *o, const char *s);
+void out_char(output *o, char c);
+void out_colored(output *o, const char *color, const char *s);
+void out_csv(output *o, const char *s);
+void out_json(output *o, const char *s);
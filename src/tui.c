@@ -13,7 +13,7 @@
 #include <locale.h>
 #include "helper.h"
 
-int unmask;
+extern int unmask;
 #define WIDE(str) stfl_ipool_towc(ipool, str)
 #define MAXFIELDLEN 32768
 
@@ -24,9 +24,8 @@ struct stfl_form *form;
 cx9r_kt_group *curGroup;
 int foldercount;
 
-const char *trail[10];
-int level_pos[10];
-int level = 0;
+#define LEVELS 10
+int level_pos[LEVELS];
 
 void addlistitem(struct stfl_form *f, wchar_t *id, char *text) {
 	char *nl = strstr(text, "\n");
@@ -56,7 +55,7 @@ void ktgroup_to_list(struct stfl_form *f, cx9r_kt_group *g) {
 	while (e != NULL) {
 		//printf("entry %s\n", cx9r_kt_entry_get_name(e));
 		//snprintf(&buf, 255, "  % -30s % -30s %s", cx9r_kt_group_get_name(e), getfield(e, "UserName"), getfield(e, "URL"));
-		snprintf(buf, 255, "  %-30s %-30s %s", cx9r_kt_entry_get_name(e), getfield(e, "UserName"), getfield(e, "URL"));
+		snprintf(buf, 255, "  %-30s %-30s %s", cx9r_kt_entry_get_name(e), getfield(e, CX9R_FIELD_USERNAME), getfield(e, CX9R_FIELD_URL));
 		addlistitem(f, L"result", buf);
 		e = cx9r_kt_entry_get_next(e);
 	}
@@ -65,15 +64,11 @@ void ktgroup_to_list(struct stfl_form *f, cx9r_kt_group *g) {
 cx9r_kt_entry *getitem(cx9r_kt_group *g, int i) {
 	i -= foldercount;
 	if (i < 0) return NULL;
-	cx9r_kt_entry *e = cx9r_kt_group_get_entries(g);
-	while(e!=NULL && i-->0) e = cx9r_kt_entry_get_next(e);
-	return e;
+	return cx9r_kt_group_get_entry(g, i);
 }
 cx9r_kt_group *getchild(cx9r_kt_group *g, int i) {
 	if (i < 0) return NULL;
-	cx9r_kt_group *c = cx9r_kt_group_get_children(g);
-	while(c!=NULL && i-->0) c = cx9r_kt_group_get_next(c);
-	return c;
+	return cx9r_kt_group_get_child(g, i);
 }
 
 void updatecuritem() {
@@ -82,12 +77,12 @@ void updatecuritem() {
 	cx9r_kt_group *child = getchild(curGroup, idx);
 	if (item != NULL) {
 		stfl_set(form, L"txt_title_val", WIDE(cx9r_kt_entry_get_name(item)));
-		stfl_set(form, L"txt_username_val", WIDE(getfield(item, "UserName")));
+		stfl_set(form, L"txt_username_val", WIDE(getfield(item, CX9R_FIELD_USERNAME)));
 		if (unmask)
 			stfl_set(form, L"unmask", L"bg=black,fg=white");
 		else stfl_set(form, L"unmask", L"bg=white,fg=white");
-		stfl_set(form, L"txt_password_val", WIDE(getfield(item, "Password")));
-		stfl_set(form, L"txt_url_val", WIDE(getfield(item, "URL")));
+		stfl_set(form, L"txt_password_val", WIDE(getfield(item, CX9R_FIELD_PASSWORD)));
+		stfl_set(form, L"txt_url_val", WIDE(getfield(item, CX9R_FIELD_URL)));
 	}
 	else if (child != NULL) {
 		stfl_set(form, L"txt_title_val", WIDE(cx9r_kt_group_get_name(child)));
@@ -119,8 +114,11 @@ void showdetails(cx9r_kt_entry *item) {
 
 void updatelist() {
 	ktgroup_to_list(form, curGroup);
-	char buf[80]; char *pos = buf; strcpy(pos, " /"); pos+=2; int i;
-	for(i=0; i<level; i++) pos += snprintf(pos, 80-(pos-buf), "%s/", trail[i]);
+	char buf[80];
+	char *path = malloc(cx9r_kt_group_get_path_length(curGroup) + 1);
+	if (path != NULL) cx9r_kt_group_get_path(curGroup, path);
+	snprintf(buf, 80, " /%s%s", path ? path : "", path && *path ? "/" : "");
+	free(path);
 	stfl_set(form, L"pathtxt", WIDE(buf));
 }
 
@@ -128,9 +126,8 @@ void openfolder() {
 	int idx = wcstol(stfl_get(form, L"listidx"), NULL, 10);
 	cx9r_kt_group *child = getchild(curGroup, idx);
 	if (child != NULL) {
-		level_pos[level] = idx;
-		trail[level] = cx9r_kt_group_get_name(child);
-		level++;
+		int level = cx9r_kt_group_get_depth(curGroup);
+		if (level < LEVELS) level_pos[level] = idx;
 		curGroup = child;
 		stfl_set(form, L"listidx", L"0");
 		updatelist();
@@ -144,10 +141,10 @@ void openfolder() {
 void parentfolder() {
 	if (cx9r_kt_group_get_parent(curGroup) != NULL) {
 		curGroup = cx9r_kt_group_get_parent(curGroup);
-		level--;
+		int level = cx9r_kt_group_get_depth(curGroup);
 		updatelist();
 		wchar_t buf[6];
-		swprintf(buf, 5, L"%d", level_pos[level]);
+		swprintf(buf, 5, L"%d", level < LEVELS ? level_pos[level] : 0);
 		stfl_set(form, L"listidx", buf);
 	}
 }